@@ -0,0 +1,285 @@
+//
+// file: bench.c
+// description: Throughput benchmark of each encode and decode phase on synthetic corpora
+//
+// @author Daniel Tregea
+//
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "bitio.h"
+#include "canonical.h"
+#include "decode.h"
+#include "encode.h"
+#include "histogram.h"
+#include "libpackman.h"
+#include "utilities.h"
+
+/// Least number of input bytes each phase is timed over
+#define BENCH_BYTES  ( 64 << 20 )
+
+/// Number of times each phase is timed, keeping the fastest
+#define BENCH_TRIES  3
+
+/// Corpus kinds the benchmark generates
+enum {
+    CORPUS_UNIFORM,  ///< uniformly random bytes
+    CORPUS_ZIPF,     ///< bytes drawn from a zipfian distribution
+    CORPUS_TEXT,     ///< words and punctuation, like prose or logs
+    CORPUS_RUNS,     ///< long runs of a few repeated bytes
+    CORPUS_SINGLE,   ///< one byte repeated
+    NUM_CORPORA
+};
+
+/// Names of the corpus kinds
+static const char * corpus_names[NUM_CORPORA] = { "uniform", "zipf", "text", "runs", "single" };
+
+/// Corpus sizes the benchmark runs, in bytes
+static const size_t corpus_sizes[] = { 64 << 10, 1 << 20, 16 << 20 };
+
+/// Advance a xorshift generator
+/// @param state Generator state, nonzero
+/// @return Next pseudo random number
+static uint64_t next_random( uint64_t * state ){
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/// Generate a corpus
+/// @param kind CORPUS_ kind to generate
+/// @param data Buffer to fill
+/// @param len Number of bytes to generate
+static void generate_corpus( int kind, uchar * data, size_t len ){
+    static const char * words[] = { "the", "of", "and", "packman", "error", "request", "GET", "200",
+                                    "timeout", "a", "in", "to", "user", "block", "INFO", "at" };
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    double cdf[256], total = 0;
+    size_t i = 0;
+    switch(kind){
+    case CORPUS_UNIFORM:
+        for(; i < len; i++)
+            data[i] = (uchar) next_random(&state);
+        break;
+    case CORPUS_ZIPF:
+        for(int symbol = 0; symbol < 256; symbol++)
+            cdf[symbol] = total += 1.0 / (symbol + 1);
+        for(; i < len; i++){
+            double target = (next_random(&state) >> 11) * (1.0 / 9007199254740992.0) * total;
+            int low = 0, high = 255;
+            while(low < high){
+                int mid = (low + high) / 2;
+                if(cdf[mid] < target)
+                    low = mid + 1;
+                else
+                    high = mid;
+            }
+            data[i] = (uchar) low;
+        }
+        break;
+    case CORPUS_TEXT:
+        while(i < len){
+            uint64_t r = next_random(&state);
+            const char * word = words[r % 16];
+            for(size_t c = 0; word[c] != NUL && i < len; c++)
+                data[i++] = word[c];
+            if(i < len)
+                data[i++] = (r >> 8) % 12 == 0 ? '\n' : (r >> 8) % 7 == 0 ? ',' : ' ';
+        }
+        break;
+    case CORPUS_RUNS:
+        while(i < len){
+            uint64_t r = next_random(&state);
+            size_t run = 1 + (r >> 8) % 4096;
+            memset(data + i, "\0\377 A"[r % 4], run < len - i ? run : len - i);
+            i += run < len - i ? run : len - i;
+        }
+        break;
+    default:
+        memset(data, 'a', len);
+        break;
+    }
+}
+
+/// Read the monotonic clock
+/// @return Current time in seconds
+static double now( void ){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/// Convert a phase time into throughput over the corpus
+/// @param len Number of corpus bytes
+/// @param seconds Time taken by one run of the phase
+/// @return Megabytes of corpus per second
+static double mb_per_second( size_t len, double seconds ){
+    return seconds > 0 ? len / seconds / (1 << 20) : 0;
+}
+
+/// Time every phase on one corpus and print a row of results
+/// @param kind CORPUS_ kind to benchmark
+/// @param len Corpus size in bytes
+/// @return 1 on success, 0 on an allocation failure or a mismatched round trip
+static int bench_corpus( int kind, size_t len ){
+    uchar * data = malloc(len), * decoded = malloc(len);
+    if(data == NULL || decoded == NULL)
+        return 0;
+    generate_corpus(kind, data, len);
+    int rounds = len >= BENCH_BYTES ? 1 : (int)(BENCH_BYTES / len);
+    double best[5] = { 1e9, 1e9, 1e9, 1e9, 1e9 };
+    uint64_t frequencies[256];
+    Code_book book;
+    Decode_table table = NULL;
+    uint * words = NULL;
+    size_t num_words = 0;
+    int ok = 1;
+
+    for(int try = 0; ok && try < BENCH_TRIES; try++){
+        // Frequency pass
+        double start = now();
+        for(int round = 0; round < rounds; round++){
+            memset(frequencies, 0, sizeof(frequencies));
+            count_frequencies(data, len, frequencies);
+        }
+        double end = now();
+        if((end - start) / rounds < best[0])
+            best[0] = (end - start) / rounds;
+
+        // Tree build, into canonical code lengths and codes
+        start = now();
+        for(int round = 0; ok && round < rounds; round++)
+            ok = build_code_book(frequencies, 0, &book);
+        end = now();
+        if((end - start) / rounds < best[1])
+            best[1] = (end - start) / rounds;
+
+        // Decode table build
+        start = now();
+        for(int round = 0; ok && round < rounds; round++){
+            if(table != NULL)
+                free_decode_table(table);
+            ok = (table = create_book_decode_table(&book)) != NULL;
+        }
+        end = now();
+        if((end - start) / rounds < best[2])
+            best[2] = (end - start) / rounds;
+
+        // Encode into a buffer of packed words
+        uint64_t num_bits = count_code_bits(frequencies, &book);
+        if(words == NULL){
+            num_words = bits_to_num_uint(num_bits);
+            ok = ok && (words = malloc((num_words + 2) * sizeof(uint))) != NULL;
+        }
+        start = now();
+        for(int round = 0; ok && round < rounds; round++){
+            Bit_writer bw;
+            bw_init_buffer(&bw, words, num_words);
+            encode_buffer(data, len, &book, &bw);
+            ok = bw_flush(&bw);
+        }
+        end = now();
+        if((end - start) / rounds < best[3])
+            best[3] = (end - start) / rounds;
+
+        // Decode back into a buffer
+        start = now();
+        for(int round = 0; ok && round < rounds; round++){
+            Bit_reader br;
+            br_init(&br, words, num_words);
+            ok = decode_symbols(&br, len, table, decoded);
+        }
+        end = now();
+        if((end - start) / rounds < best[4])
+            best[4] = (end - start) / rounds;
+        ok = ok && memcmp(data, decoded, len) == 0;
+    }
+
+    // Ratio of a whole packman file, headers included
+    uchar * packed = NULL;
+    size_t packed_len = 0;
+    Packman ctx = packman_create(NULL);
+    ok = ok && ctx != NULL && packman_encode_buffer(ctx, data, len, &packed, &packed_len);
+
+    // Whole file encode and decode with the code book rebuilt as the model adapts
+    Packman_options options;
+    packman_default_options(&options);
+    options.dynamic = 1;
+    Packman dynamic_ctx = packman_create(&options);
+    uchar * dynamic_packed = NULL, * dynamic_decoded = NULL;
+    size_t dynamic_len = 0, dynamic_decoded_len = 0;
+    double dynamic_best[2] = { 1e9, 1e9 };
+    ok = ok && dynamic_ctx != NULL;
+    for(int try = 0; ok && try < BENCH_TRIES; try++){
+        free(dynamic_packed);
+        free(dynamic_decoded);
+        dynamic_packed = dynamic_decoded = NULL;
+        double start = now();
+        ok = packman_encode_buffer(dynamic_ctx, data, len, &dynamic_packed, &dynamic_len);
+        double middle = now();
+        ok = ok && packman_decode_buffer(dynamic_ctx, dynamic_packed, dynamic_len, &dynamic_decoded, &dynamic_decoded_len);
+        double end = now();
+        if(middle - start < dynamic_best[0])
+            dynamic_best[0] = middle - start;
+        if(end - middle < dynamic_best[1])
+            dynamic_best[1] = end - middle;
+        ok = ok && dynamic_decoded_len == len && memcmp(data, dynamic_decoded, len) == 0;
+    }
+
+    if(ok){
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        printf("%-8s %6zuK %9.0f %9.0f %9.0f %9.0f %9.0f %7.3f %9.0f %9.0f %7.3f %8ldK\n",
+               corpus_names[kind], len >> 10,
+               mb_per_second(len, best[0]), mb_per_second(len, best[1]), mb_per_second(len, best[2]),
+               mb_per_second(len, best[3]), mb_per_second(len, best[4]),
+               (double) packed_len / len, mb_per_second(len, dynamic_best[0]),
+               mb_per_second(len, dynamic_best[1]), (double) dynamic_len / len, usage.ru_maxrss);
+        fflush(stdout);
+    }
+    if(ctx != NULL)
+        packman_destroy(ctx);
+    if(dynamic_ctx != NULL)
+        packman_destroy(dynamic_ctx);
+    free(dynamic_packed);
+    free(dynamic_decoded);
+    if(table != NULL)
+        free_decode_table(table);
+    free(packed);
+    free(words);
+    free(data);
+    free(decoded);
+    return ok;
+}
+
+/// Run every corpus at every size, each in its own process so peak RSS
+/// is measured per run
+int main( void ){
+    printf("MB/s of corpus for each phase; ratio is packman file size over corpus size;\n"
+           "dyn columns encode and decode whole files with a code book rebuilt as the model adapts\n");
+    printf("%-8s %7s %9s %9s %9s %9s %9s %7s %9s %9s %7s %9s\n",
+           "corpus", "size", "freq", "tree", "table", "encode", "decode", "ratio",
+           "dyn enc", "dyn dec", "dyn rat", "peak RSS");
+    fflush(stdout);
+    int status = EXIT_SUCCESS;
+    for(int kind = 0; kind < NUM_CORPORA; kind++){
+        for(size_t s = 0; s < sizeof(corpus_sizes) / sizeof(corpus_sizes[0]); s++){
+            pid_t pid = fork();
+            if(pid == 0)
+                _exit(bench_corpus(kind, corpus_sizes[s]) ? EXIT_SUCCESS : EXIT_FAILURE);
+            int child;
+            if(pid < 0 || waitpid(pid, &child, 0) != pid || !WIFEXITED(child) || WEXITSTATUS(child) != EXIT_SUCCESS){
+                fprintf(stderr, "bench: %s %zuK failed\n", corpus_names[kind], corpus_sizes[s] >> 10);
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+    return status;
+}
@@ -0,0 +1,162 @@
+//
+// file: bench_tree.c
+// description: Microbenchmark of the cost of building one block's code book
+//
+// @author Daniel Tregea
+//
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+#include <time.h>
+#include "HeapDT.h"
+#include "encode.h"
+
+/// Number of code books built per measurement
+#define BENCH_ROUNDS  20000
+
+/// Code_length_fn computes huffman code lengths from symbol frequencies
+typedef int (*Code_length_fn)( const uint64_t * frequencies, uchar * lengths );
+
+/// Read the monotonic clock
+/// @return Current time in nanoseconds
+static double now_ns( void ){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/// Fill frequencies for one of the benchmark distributions
+/// @param kind Distribution number, 0 to 4
+/// @param frequencies Array of 256 counts to fill
+/// @return Name of the distribution
+static const char * fill_frequencies( int kind, uint64_t * frequencies ){
+    memset(frequencies, 0, 256 * sizeof(uint64_t));
+    switch(kind){
+    case 0: // every byte about as likely, as in compressed data
+        for(int i = 0; i < 256; i++)
+            frequencies[i] = 1000 + (i * 7919) % 97;
+        return "uniform";
+    case 1: // zipfian over the whole alphabet
+        for(int i = 0; i < 256; i++)
+            frequencies[i] = (uint64_t)(1e7 / (i + 1));
+        return "zipf";
+    case 2: // printable text
+        for(int i = 32; i < 127; i++)
+            frequencies[i] = (uint64_t)(1e6 * exp(-(i - 32) / 12.0)) + 1;
+        frequencies['\n'] = 20000;
+        return "text";
+    case 3: // fibonacci counts, the deepest possible tree
+        frequencies[0] = frequencies[1] = 1;
+        for(int i = 2; i < 40; i++)
+            frequencies[i] = frequencies[i - 1] + frequencies[i - 2];
+        return "fibonacci";
+    default: // a handful of symbols
+        frequencies['A'] = 500;
+        frequencies['C'] = 300;
+        frequencies['G'] = 200;
+        frequencies['T'] = 100;
+        return "4 symbols";
+    }
+}
+
+/// Comparison function for min heaps
+/// @param first_node Node to be compared to second_node
+/// @param second_node Node to be compared to first_node
+/// @return Whether first_node is less than second_node
+static int compare_node_min( const void * first_node, const void * second_node ){
+    Tree_node left = (Tree_node)first_node;
+    Tree_node right = (Tree_node)second_node;
+    return left->freq < right->freq;
+}
+
+/// Print function for frequency heap nodes
+/// @param item Frequency heap node to print
+/// @param outfp Stream to print node to
+static void print_node( const void * item, FILE * outfp ){
+    Tree_node node = (Tree_node) item;
+    fprintf(outfp, "Frequency: %" PRIu64 ", Symbol: %u\n", node->freq, node->sym);
+}
+
+/// Compute huffman code lengths the way packman first did, through the
+/// generic HeapDT, for comparison
+/// @param frequencies Number of occurrences of each of the 256 symbols
+/// @param lengths Array of 256 code lengths to fill
+/// @return 1 on success, 0 if there are no symbols or a code is too long
+static int hdt_code_lengths( const uint64_t * frequencies, uchar * lengths ){
+    Node_arena arena;
+    arena_reset(&arena);
+    Heap heap = hdt_create(257, compare_node_min, print_node);
+    for(int i = 0; i < 256; i++)
+        if(frequencies[i] > 0)
+            hdt_insert_item(heap, create_tree_node(&arena, i, frequencies[i], 0));
+    if(hdt_size(heap) == 0){
+        hdt_destroy(heap);
+        return 0;
+    }
+    while(hdt_size(heap) >= 2){
+        Tree_node n1 = hdt_remove_top(heap);
+        Tree_node n2 = hdt_remove_top(heap);
+        Tree_node nx = create_tree_node(&arena, 0, n1->freq + n2->freq, 1);
+        nx->left = n1;
+        nx->right = n2;
+        hdt_insert_item(heap, nx);
+    }
+    int built = tree_code_lengths((Tree_node) hdt_top(heap), lengths);
+    hdt_destroy(heap);
+    return built;
+}
+
+/// Time BENCH_ROUNDS code length computations
+/// @param fn Code length function to time
+/// @param frequencies Number of occurrences of each of the 256 symbols
+/// @param lengths Array of 256 code lengths to fill
+/// @return Nanoseconds per computation
+static double time_lengths( Code_length_fn fn, const uint64_t * frequencies, uchar * lengths ){
+    double start = now_ns();
+    for(int round = 0; round < BENCH_ROUNDS; round++)
+        fn(frequencies, lengths);
+    return (now_ns() - start) / BENCH_ROUNDS;
+}
+
+/// Total number of code bits a set of code lengths needs
+/// @param frequencies Number of occurrences of each of the 256 symbols
+/// @param lengths Array of 256 code lengths
+/// @return Sum of frequency times code length
+static uint64_t total_bits( const uint64_t * frequencies, const uchar * lengths ){
+    uint64_t bits = 0;
+    for(int i = 0; i < 256; i++)
+        bits += frequencies[i] * lengths[i];
+    return bits;
+}
+
+/// Compare the HeapDT and two-queue tree builders, and time a whole code
+/// book build, on several symbol distributions
+int main( void ){
+    printf("%-10s %12s %12s %12s\n", "symbols", "HeapDT ns", "two-queue ns", "code book ns");
+    for(int kind = 0; kind < 5; kind++){
+        uint64_t frequencies[256];
+        uchar hdt_lengths[256], queue_lengths[256];
+        Code_book book;
+        const char * name = fill_frequencies(kind, frequencies);
+
+        double hdt_ns = time_lengths(hdt_code_lengths, frequencies, hdt_lengths);
+        double queue_ns = time_lengths(huffman_code_lengths, frequencies, queue_lengths);
+        double start = now_ns();
+        for(int round = 0; round < BENCH_ROUNDS; round++)
+            build_code_book(frequencies, 0, &book);
+        double book_ns = (now_ns() - start) / BENCH_ROUNDS;
+
+        // Every builder is optimal, though ties may shape the trees differently
+        uint64_t bits = total_bits(frequencies, queue_lengths);
+        if(total_bits(frequencies, hdt_lengths) != bits){
+            fprintf(stderr, "%s: code lengths differ in cost\n", name);
+            return EXIT_FAILURE;
+        }
+        printf("%-10s %12.0f %12.0f %12.0f\n", name, hdt_ns, queue_ns, book_ns);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+//
+// file: bitio.c
+// description: Implementation file for reading and writing packed code bits
+//
+// @author Daniel Tregea
+//
+
+#include <stdlib.h>
+#include "bitio.h"
+
+/// Prepare a bit reader over an array of packed unsigned integers
+/// @param br Bit reader to initialize
+/// @param words Packed code bits
+/// @param num_words Number of unsigned integers in words
+void br_init( Bit_reader * br, const uint * words, size_t num_words ){
+    br->words = words;
+    br->num_words = num_words;
+    br->next_word = 0;
+    br->acc = 0;
+    br->count = 0;
+    br->fp = NULL;
+    br->buf = NULL;
+    br->words_left = 0;
+    br->truncated = 0;
+}
+
+/// Prepare a bit reader that reads packed unsigned integers from a stream
+/// @param br Bit reader to initialize
+/// @param fp Input stream positioned at the first word of the payload
+/// @param num_words Number of unsigned integers in the payload
+/// @return 1 on success, 0 on allocation failure
+int br_init_stream( Bit_reader * br, FILE * fp, uint64_t num_words ){
+    br_init(br, NULL, 0);
+    br->fp = fp;
+    br->words_left = num_words;
+    br->buf = malloc(BR_BUFWORDS * sizeof(uint));
+    br->words = br->buf;
+    return br->buf != NULL;
+}
+
+/// Read the next chunk of words from the stream of a streaming reader
+/// @param br Bit reader whose buffer is exhausted
+void br_read_words( Bit_reader * br ){
+    size_t wanted = br->words_left < BR_BUFWORDS ? br->words_left : BR_BUFWORDS;
+    size_t num_read = fread(br->buf, sizeof(uint), wanted, br->fp);
+    br->truncated = num_read < wanted;
+    br->words_left = br->truncated ? 0 : br->words_left - num_read; // stop at a short read
+    br->num_words = num_read;
+    br->next_word = 0;
+}
+
+/// Top up the accumulator once the words in memory have run out, reading
+/// the next chunk of a streaming reader. Words past the end of the payload,
+/// or past a short read, read as zero.
+/// @param br Bit reader to refill
+void br_refill_end( Bit_reader * br ){
+    while(br->count <= 32){
+        if(br->next_word >= br->num_words && br->words_left > 0)
+            br_read_words(br);
+        uint64_t word = br->next_word < br->num_words ? br->words[br->next_word] : 0;
+        br->next_word++;
+        br->acc |= word << (32 - br->count);
+        br->count += 32;
+    }
+}
+
+/// Free the chunk buffer of a streaming bit reader
+/// @param br Bit reader to destroy
+void br_destroy( Bit_reader * br ){
+    free(br->buf);
+    br->buf = NULL;
+    br->words = NULL;
+}
+
+/// Prepare a bit writer that appends packed words to a stream
+/// @param bw Bit writer to initialize
+/// @param fp Output stream to write to
+/// @return 1 on success, 0 on allocation failure
+int bw_init( Bit_writer * bw, FILE * fp ){
+    bw_init_buffer(bw, malloc(BW_BUFWORDS * sizeof(uint)), BW_BUFWORDS);
+    bw->fp = fp;
+    return bw->words != NULL;
+}
+
+/// Prepare a bit writer that packs words into a caller's array
+/// @param bw Bit writer to initialize
+/// @param words Array to pack into, still owned by the caller
+/// @param capacity Number of words the array holds
+void bw_init_buffer( Bit_writer * bw, uint * words, size_t capacity ){
+    bw->fp = NULL;
+    bw->words = words;
+    bw->num_words = 0;
+    bw->capacity = capacity;
+    bw->acc = 0;
+    bw->count = 0;
+    bw->total_bits = 0;
+    bw->error = 0;
+}
+
+/// Write the complete words in the buffer to the output stream.
+/// A buffer writer has nowhere to drain to, so draining it is an overflow.
+/// @param bw Bit writer to drain
+void bw_drain( Bit_writer * bw ){
+    if(bw->fp == NULL){
+        bw->error = 1;
+        bw->num_words = 0;
+        return;
+    }
+    if(bw->num_words > 0 && fwrite(bw->words, sizeof(uint), bw->num_words, bw->fp) != bw->num_words)
+        bw->error = 1;
+    bw->num_words = 0;
+}
+
+/// Write out every buffered word, padding the last word with zeros
+/// @param bw Bit writer to flush
+/// @return 1 on success, 0 if any write failed
+int bw_flush( Bit_writer * bw ){
+    if(bw->count > 0){
+        if(bw->num_words == bw->capacity)
+            bw_drain(bw);
+        bw->words[bw->num_words++] = (uint)(bw->acc << (BITS_IN_INT - bw->count));
+        bw->acc = 0;
+        bw->count = 0;
+    }
+    if(bw->fp != NULL)
+        bw_drain(bw);
+    return !bw->error;
+}
+
+/// Free the buffer of a stream bit writer
+/// @param bw Bit writer to destroy
+void bw_destroy( Bit_writer * bw ){
+    if(bw->fp != NULL)
+        free(bw->words);
+    bw->words = NULL;
+}
@@ -0,0 +1,172 @@
+//
+// file: bitio.h
+// description: Definition file for reading and writing packed code bits
+//
+// @author Daniel Tregea
+//
+
+#ifndef BITIO_H
+#define BITIO_H
+#include <stdio.h>
+#include <stddef.h>
+#include "packman_utils.h"
+
+/// Number of packed words a streaming bit reader reads at a time
+#define BR_BUFWORDS  ( BUFSIZE * 64 )
+
+/// Bit_reader pulls bits from packed unsigned integers, either from an
+/// array in memory or from a stream read in fixed size chunks.
+/// Bits are kept left aligned in a 64 bit accumulator so the next code
+/// can be peeked at with a single shift.
+typedef struct Bit_reader_s {
+    const uint * words;   ///< packed code bits, most significant bit first
+    size_t num_words;     ///< number of unsigned integers in words
+    size_t next_word;     ///< index of the next word to load into acc
+    uint64_t acc;         ///< left aligned bit accumulator
+    uint count;           ///< number of valid bits held in acc
+    FILE * fp;            ///< stream words are read from, or NULL
+    uint * buf;           ///< chunk buffer owned by a streaming reader
+    uint64_t words_left;  ///< words of the payload not yet read from fp
+    int truncated;        ///< nonzero once fp ended before the payload did
+} Bit_reader;
+
+/// Prepare a bit reader over an array of packed unsigned integers
+/// @param br Bit reader to initialize
+/// @param words Packed code bits
+/// @param num_words Number of unsigned integers in words
+void br_init( Bit_reader * br, const uint * words, size_t num_words );
+
+/// Prepare a bit reader that reads packed unsigned integers from a stream
+/// @param br Bit reader to initialize
+/// @param fp Input stream positioned at the first word of the payload
+/// @param num_words Number of unsigned integers in the payload
+/// @return 1 on success, 0 on allocation failure
+int br_init_stream( Bit_reader * br, FILE * fp, uint64_t num_words );
+
+/// Read the next chunk of words from the stream of a streaming reader
+/// @param br Bit reader whose buffer is exhausted
+void br_read_words( Bit_reader * br );
+
+/// Free the chunk buffer of a streaming bit reader
+/// @param br Bit reader to destroy
+void br_destroy( Bit_reader * br );
+
+/// Top up the accumulator once the words in memory have run out, reading
+/// the next chunk of a streaming reader. Words past the end of the payload,
+/// or past a short read, read as zero.
+/// @param br Bit reader to refill
+void br_refill_end( Bit_reader * br );
+
+/// Top up the accumulator so that more than 32 bits are available.
+/// Words past the end of the payload read as zero.
+/// @param br Bit reader to refill
+static inline void br_refill( Bit_reader * br ){
+    if(br->count <= 32){
+        if(br->next_word < br->num_words){
+            br->acc |= (uint64_t) br->words[br->next_word++] << (32 - br->count);
+            br->count += 32;
+        } else
+            br_refill_end(br);
+    }
+}
+
+/// Look at the next bits of the stream without consuming them
+/// @param br Bit reader to peek
+/// @param n Number of bits to peek, 1 to 32
+/// @return The next n bits right aligned in an unsigned integer
+static inline uint br_peek( const Bit_reader * br, uint n ){
+    return (uint)(br->acc >> (64 - n));
+}
+
+/// Consume bits from the stream
+/// @param br Bit reader to advance
+/// @param n Number of bits to consume, no more than br->count
+static inline void br_skip( Bit_reader * br, uint n ){
+    br->acc <<= n;
+    br->count -= n;
+}
+
+/// Count the bits consumed from a bit reader over an array in memory,
+/// from the first bit of its words
+/// @param br Bit reader prepared with br_init
+/// @return Number of bits consumed
+static inline uint64_t br_bits_used( const Bit_reader * br ){
+    return (uint64_t) br->next_word * BITS_IN_INT - br->count;
+}
+
+/// Number of packed words a bit writer buffers before writing them out
+#define BW_BUFWORDS  ( BUFSIZE * 64 )
+
+/// Bit_writer packs code bits into unsigned integers, most significant bit
+/// first. Codes are shifted into a 64 bit accumulator and whole words are
+/// moved out of it, so a code costs one shift and one or no word store.
+/// A stream writer writes the words to its stream whenever its buffer
+/// fills, so memory use does not grow with the size of the output.
+/// A buffer writer packs into a caller's array sized for the whole output.
+typedef struct Bit_writer_s {
+    FILE * fp;            ///< stream the packed words are written to, or NULL
+    uint * words;         ///< buffer of packed words waiting to be written
+    size_t num_words;     ///< number of complete words in the buffer
+    size_t capacity;      ///< number of words the buffer can hold
+    uint64_t acc;         ///< right aligned bits not yet moved into a word
+    uint count;           ///< number of bits held in acc, less than 32 between calls
+    uint64_t total_bits;  ///< number of bits written so far
+    int error;            ///< nonzero once a write has failed or overflowed
+} Bit_writer;
+
+/// Prepare a bit writer that appends packed words to a stream
+/// @param bw Bit writer to initialize
+/// @param fp Output stream to write to
+/// @return 1 on success, 0 on allocation failure
+int bw_init( Bit_writer * bw, FILE * fp );
+
+/// Prepare a bit writer that packs words into a caller's array
+/// @param bw Bit writer to initialize
+/// @param words Array to pack into, still owned by the caller
+/// @param capacity Number of words the array holds
+void bw_init_buffer( Bit_writer * bw, uint * words, size_t capacity );
+
+/// Write the complete words in the buffer to the output stream.
+/// A buffer writer has nowhere to drain to, so draining it is an overflow.
+/// @param bw Bit writer to drain
+void bw_drain( Bit_writer * bw );
+
+/// Append up to 32 bits to the stream
+/// @param bw Bit writer to append to
+/// @param code Code bits, right aligned
+/// @param length Number of bits in code, at most 32
+static inline void bw_put_word_bits( Bit_writer * bw, uint64_t code, uint length ){
+    bw->acc = (bw->acc << length) | code;
+    bw->count += length;
+    bw->total_bits += length;
+    if(bw->count >= BITS_IN_INT){ // a whole word is ready, move it into the buffer
+        bw->count -= BITS_IN_INT;
+        if(bw->num_words == bw->capacity)
+            bw_drain(bw);
+        bw->words[bw->num_words++] = (uint)(bw->acc >> bw->count);
+    }
+}
+
+/// Append the bits of a symbol code to the stream
+/// @param bw Bit writer to append to
+/// @param code Code bits, right aligned
+/// @param length Number of bits in code, at most 64
+static inline void bw_put_bits( Bit_writer * bw, uint64_t code, uint length ){
+    if(length > BITS_IN_INT){
+        bw_put_word_bits(bw, code >> BITS_IN_INT, length - BITS_IN_INT);
+        code &= UINT32_MAX;
+        length = BITS_IN_INT;
+    }
+    bw_put_word_bits(bw, code, length);
+}
+
+/// Write out every buffered word, padding the last word with zeros
+/// @param bw Bit writer to flush
+/// @return 1 on success, 0 if any write failed
+int bw_flush( Bit_writer * bw );
+
+/// Free the buffer of a stream bit writer
+/// @param bw Bit writer to destroy
+void bw_destroy( Bit_writer * bw );
+
+#endif
@@ -0,0 +1,1102 @@
+//
+// file: blocks.c
+// description: Implementation file for block framed files compressed in parallel
+//
+// @author Daniel Tregea
+//
+
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "blocks.h"
+#include "bitio.h"
+#include "canonical.h"
+#include "encode.h"
+#include "histogram.h"
+#include "decode.h"
+#include "ring.h"
+#include "stats.h"
+#include "threadpool.h"
+#include "utilities.h"
+
+/// Number of blocks read ahead for each worker thread
+#define BLOCKS_PER_THREAD  2
+
+/// Number of batches of blocks in flight: one filled and compressed while
+/// the writer thread writes the other
+#define NUM_BATCHES  2
+
+/// Number of input chunks the reader thread may read ahead of the encoder
+#define READ_CHUNKS  4
+
+/// Number of input bytes whose statistics are compared at a time in adaptive mode
+#define SPLIT_WINDOW  ( 64 << 10 )
+
+/// Rough cost of starting a block: flags, packed code lengths, symbol and bit counts
+#define SPLIT_HEADER_BITS  ( CODE_LENGTHS_BITS + (1 + 4 + 8) * 8 )
+
+/// Block_job holds one block while it is compressed on a worker thread
+typedef struct Block_job_s {
+    const uchar * data;   ///< input bytes of the block, in the input mapping or buf
+    uchar * buf;          ///< copy of the block for input that isn't mapped
+    size_t len;           ///< number of input bytes in data
+    uint max_length;      ///< longest code length allowed
+    int interleaved;      ///< nonzero to code the block as NUM_STREAMS streams
+    int counted;          ///< nonzero if frequencies already holds the block's counts
+    uint64_t frequencies[256];  ///< number of occurrences of each symbol in the block
+    int repeat;           ///< nonzero if the block reuses the previous block's code book
+    Code_book book;       ///< code book the block is coded with
+    uint64_t num_bits;    ///< number of code bits in words
+    uint64_t stream_bits[NUM_STREAMS];  ///< code bits of each interleaved stream
+    int timed;            ///< nonzero to time the block's phases in timings
+    Packman_stats timings;  ///< time the workers spent on the block
+    uint * words;         ///< packed code bits of the block
+    size_t num_words;     ///< number of words of code bits in words
+    size_t capacity;      ///< number of words allocated for words
+    int ok;               ///< nonzero once the block has been encoded
+} Block_job;
+
+/// Count the symbols of one block
+/// @param arg The Block_job to count
+static void count_block( void * arg ){
+    Block_job * job = arg;
+    Packman_stats * stats = job->timed ? &job->timings : NULL;
+    double start = stats_start(stats);
+    memset(job->frequencies, 0, sizeof(job->frequencies));
+    count_frequencies(job->data, job->len, job->frequencies);
+    job->counted = 1;
+    stats_stop(stats, PACKMAN_PHASE_COUNT, start);
+}
+
+/// Compress one block whose code book has been chosen: pack the codes
+/// @param arg The Block_job to compress
+static void encode_block( void * arg ){
+    Block_job * job = arg;
+    Packman_stats * stats = job->timed ? &job->timings : NULL;
+    double start = stats_start(stats);
+
+    // Interleaved streams each start on a word boundary
+    size_t num_words;
+    if(job->interleaved){
+        count_stream_bits(job->data, job->len, &job->book, job->stream_bits);
+        num_words = 0;
+        for(int stream = 0; stream < NUM_STREAMS; stream++)
+            num_words += bits_to_num_uint(job->stream_bits[stream]);
+    } else{
+        job->num_bits = count_code_bits(job->frequencies, &job->book);
+        num_words = bits_to_num_uint(job->num_bits);
+    }
+    if(num_words > job->capacity){
+        free(job->words);
+        job->words = malloc(num_words * sizeof(uint));
+        job->capacity = job->words == NULL ? 0 : num_words;
+        if(job->words == NULL){
+            job->ok = 0;
+            return;
+        }
+    }
+    job->num_words = num_words;
+
+    if(!job->interleaved){
+        Bit_writer bw;
+        bw_init_buffer(&bw, job->words, job->capacity);
+        encode_buffer(job->data, job->len, &job->book, &bw);
+        job->ok = bw_flush(&bw);
+    } else{
+        Bit_writer bw[NUM_STREAMS];
+        uint * words = job->words;
+        for(int stream = 0; stream < NUM_STREAMS; stream++){
+            bw_init_buffer(&bw[stream], words, bits_to_num_uint(job->stream_bits[stream]));
+            words += bw[stream].capacity;
+        }
+        encode_interleaved(job->data, job->len, &job->book, bw);
+        for(int stream = 0; stream < NUM_STREAMS; stream++)
+            job->ok = bw_flush(&bw[stream]) && job->ok;
+    }
+    stats_stop(stats, PACKMAN_PHASE_ENCODE, start);
+}
+
+/// Write a compressed block: header, code lengths, counts and code bits
+/// @param out Output stream to write to
+/// @param job Compressed block
+/// @return 1 on success, 0 on write failure
+static int write_block( FILE * out, const Block_job * job ){
+    uchar flags[1] = { (job->interleaved ? BLOCK_INTERLEAVED : 0) | (job->repeat ? BLOCK_REPEAT : 0) };
+    uint num_symbols[1] = { (uint) job->len };
+    uint64_t num_bits[1] = { job->num_bits };
+    int ok = fwrite(flags, sizeof(uchar), 1, out) == 1
+          && (job->repeat || write_code_lengths(out, job->book.length))
+          && fwrite(num_symbols, sizeof(uint), 1, out) == 1;
+    if(job->interleaved)
+        ok = ok && fwrite(job->stream_bits, sizeof(uint64_t), NUM_STREAMS, out) == NUM_STREAMS;
+    else
+        ok = ok && fwrite(num_bits, sizeof(uint64_t), 1, out) == 1;
+    return ok && fwrite(job->words, sizeof(uint), job->num_words, out) == job->num_words;
+}
+
+/// Block_batch holds the jobs of one batch of blocks
+typedef struct Block_batch_s {
+    Block_job * jobs;       ///< one job per block of the batch
+    int num_ready;          ///< number of compressed blocks to write
+    int ok;                 ///< zero once writing the batch has failed
+} Block_batch;
+
+/// Definition of block_encoder_s
+struct block_encoder_s {
+    Block_options options;  ///< block size, thread count and code length limit
+    FILE * out;             ///< output stream the blocks are written to
+    Thread_pool pool;       ///< workers compressing a batch of blocks
+    Block_batch batches[NUM_BATCHES];  ///< batches taking turns being filled and written
+    Block_batch * batch;    ///< batch being filled
+    Block_job * jobs;       ///< jobs of the batch being filled
+    int num_jobs;           ///< number of blocks in a full batch
+    int num_ready;          ///< number of blocks waiting for the next batch
+    Ring full;              ///< compressed batches for the writer thread, or NULL to write them in place
+    Ring empty;             ///< batches the writer thread has written
+    pthread_t writer;       ///< thread writing compressed batches in order
+    Code_book book;         ///< code book of the last block given one
+    int has_book;           ///< nonzero once a block has been given a code book
+    size_t fill;            ///< bytes pushed into the buffer of the next block
+    int ok;                 ///< zero once anything has failed
+};
+
+/// Start a block encoder and write the FORMAT_BLOCKS file header
+/// @param out Output stream to write the file to
+/// @param options Block size, thread count and code length limit
+/// @return a Block_encoder instance, or NULL on allocation or write failure
+Block_encoder block_encoder_create( FILE * out, const Block_options * options ){
+    Block_encoder encoder = calloc(1, sizeof(struct block_encoder_s));
+    if(encoder == NULL)
+        return NULL;
+    encoder->options = *options;
+    encoder->out = out;
+    encoder->pool = tp_create(options->num_threads);
+    encoder->num_jobs = encoder->pool == NULL ? 0 : tp_num_threads(encoder->pool) * BLOCKS_PER_THREAD;
+    encoder->ok = encoder->pool != NULL;
+    for(int b = 0; b < NUM_BATCHES; b++){
+        Block_batch * batch = &encoder->batches[b];
+        batch->jobs = calloc(encoder->num_jobs, sizeof(Block_job));
+        batch->ok = 1;
+        encoder->ok = encoder->ok && batch->jobs != NULL;
+        for(int i = 0; encoder->ok && i < encoder->num_jobs; i++){
+            batch->jobs[i].max_length = options->max_length;
+            batch->jobs[i].interleaved = options->interleaved;
+            batch->jobs[i].timed = options->stats != NULL;
+        }
+    }
+    encoder->batch = &encoder->batches[0];
+    encoder->jobs = encoder->batch->jobs;
+
+    uint block_size[1] = { (uint) options->block_size };
+    encoder->ok = encoder->ok && write_container_header(out, FORMAT_BLOCKS)
+                  && fwrite(block_size, sizeof(uint), 1, out) == 1;
+    if(!encoder->ok){
+        block_encoder_destroy(encoder);
+        return NULL;
+    }
+    return encoder;
+}
+
+/// Check how many code bits a block needs with a code book
+/// @param frequencies Number of occurrences of each of the 256 symbols
+/// @param book Code book of symbol codes
+/// @param num_bits Set to the total number of code bits
+/// @return 1 on success, 0 if a symbol of the block has no code in the book
+static int book_code_bits( const uint64_t * frequencies, const Code_book * book, uint64_t * num_bits ){
+    for(int i = 0; i < 256; i++)
+        if(frequencies[i] > 0 && book->length[i] == 0)
+            return 0;
+    *num_bits = count_code_bits(frequencies, book);
+    return 1;
+}
+
+/// Build the one code book of a sampled encode from the leading bytes of
+/// the first batch. Every symbol is counted once more than it was seen, so
+/// symbols missing from the sample still get a code for later blocks.
+/// @param encoder The subject Block_encoder
+/// @return 1 on success, 0 if no code book fits the code length limit
+static int build_sample_book( Block_encoder encoder ){
+    Packman_stats * stats = encoder->options.stats;
+    double start = stats_start(stats);
+    uint64_t frequencies[256];
+    for(int i = 0; i < 256; i++)
+        frequencies[i] = 1;
+    size_t remaining = encoder->options.sample_size;
+    for(int i = 0; remaining > 0 && i < encoder->num_ready; i++){
+        const Block_job * job = &encoder->jobs[i];
+        size_t len = job->len < remaining ? job->len : remaining;
+        if(len == job->len){
+            for(int symbol = 0; symbol < 256; symbol++)
+                frequencies[symbol] += job->frequencies[symbol];
+        } else
+            count_frequencies(job->data, len, frequencies);
+        remaining -= len;
+    }
+    if(!build_code_book(frequencies, encoder->options.max_length, &encoder->book))
+        return 0;
+    if(stats != NULL)
+        stats->num_books++;
+    stats_stop(stats, PACKMAN_PHASE_BUILD, start);
+    return 1;
+}
+
+/// Choose the code book of a block. The previous block's code book is
+/// repeated when coding with it costs no more than a new code book and its
+/// code lengths. Huffman codes never beat the entropy, so a previous code
+/// book within the entropy estimate is repeated without building a new one.
+/// In a sampled encode the first block carries the sampled code book and
+/// every other block repeats it.
+/// @param encoder The subject Block_encoder
+/// @param job Counted block to give a code book
+static void choose_code_book( Block_encoder encoder, Block_job * job ){
+    if(encoder->options.sample_size > 0){
+        job->repeat = encoder->has_book;
+        job->book = encoder->book;
+        encoder->has_book = 1;
+        job->ok = 1;
+        return;
+    }
+    Packman_stats * stats = encoder->options.stats;
+    double start = stats_start(stats);
+    uint64_t previous_bits = 0;
+    int usable = encoder->has_book && book_code_bits(job->frequencies, &encoder->book, &previous_bits);
+    job->repeat = usable && previous_bits <= entropy_bits(job->frequencies) + CODE_LENGTHS_BITS;
+    if(!job->repeat){
+        job->ok = build_code_book(job->frequencies, job->max_length, &job->book);
+        if(!job->ok)
+            return;
+        job->repeat = usable && previous_bits <= count_code_bits(job->frequencies, &job->book) + CODE_LENGTHS_BITS;
+    }
+    if(job->repeat)
+        job->book = encoder->book;
+    else{
+        encoder->book = job->book;
+        encoder->has_book = 1;
+        if(stats != NULL)
+            stats->num_books++;
+    }
+    job->ok = 1;
+    stats_stop(stats, PACKMAN_PHASE_BUILD, start);
+}
+
+/// Add the timings and counters of a compressed block to the encoder's statistics
+/// @param stats Statistics to add to
+/// @param job Compressed block
+static void add_block_stats( Packman_stats * stats, Block_job * job ){
+    stats->seconds[PACKMAN_PHASE_COUNT] += job->timings.seconds[PACKMAN_PHASE_COUNT];
+    stats->seconds[PACKMAN_PHASE_ENCODE] += job->timings.seconds[PACKMAN_PHASE_ENCODE];
+    memset(&job->timings, 0, sizeof(job->timings));
+    stats->num_blocks++;
+    stats->num_symbols += job->len;
+    if(job->interleaved)
+        for(int stream = 0; stream < NUM_STREAMS; stream++)
+            stats->code_bits += job->stream_bits[stream];
+    else
+        stats->code_bits += job->num_bits;
+    for(int i = 0; i < 256; i++)
+        if(job->book.length[i] > stats->longest_code)
+            stats->longest_code = job->book.length[i];
+}
+
+/// Write the compressed blocks of a batch in order
+/// @param encoder The subject Block_encoder
+/// @param batch Batch of compressed blocks
+static void write_batch( Block_encoder encoder, Block_batch * batch ){
+    Packman_stats * stats = encoder->options.stats;
+    double start = stats_start(stats);
+    for(int i = 0; batch->ok && i < batch->num_ready; i++)
+        batch->ok = write_block(encoder->out, &batch->jobs[i]);
+    stats_stop(stats, PACKMAN_PHASE_WRITE, start);
+}
+
+/// Write the batches handed over by encode_batch until given NULL
+/// @param arg The Block_encoder whose batches are written
+/// @return NULL
+static void * batch_writer( void * arg ){
+    Block_encoder encoder = arg;
+    Block_batch * batch;
+    while((batch = ring_pop(encoder->full)) != NULL){
+        write_batch(encoder, batch);
+        ring_push(encoder->empty, batch);
+    }
+    return NULL;
+}
+
+/// Start a writer thread, so a batch is written while the next is compressed.
+/// If the thread can't be started, batches are written in place instead.
+/// @param encoder The subject Block_encoder
+static void start_writer( Block_encoder encoder ){
+    encoder->full = ring_create(NUM_BATCHES);
+    encoder->empty = ring_create(NUM_BATCHES);
+    if(encoder->full != NULL && encoder->empty != NULL){
+        for(int b = 1; b < NUM_BATCHES; b++)
+            ring_push(encoder->empty, &encoder->batches[b]);
+        if(pthread_create(&encoder->writer, NULL, batch_writer, encoder) == 0)
+            return;
+    }
+    if(encoder->full != NULL)
+        ring_destroy(encoder->full);
+    if(encoder->empty != NULL)
+        ring_destroy(encoder->empty);
+    encoder->full = encoder->empty = NULL;
+}
+
+/// Wait for the writer thread to write every batch handed to it, and stop it
+/// @param encoder The subject Block_encoder
+/// @return 1 if every batch was written, 0 on a write failure
+static int stop_writer( Block_encoder encoder ){
+    if(encoder->full == NULL)
+        return 1;
+    ring_push(encoder->full, NULL);
+    pthread_join(encoder->writer, NULL);
+    ring_destroy(encoder->full);
+    ring_destroy(encoder->empty);
+    encoder->full = encoder->empty = NULL;
+    int ok = 1;
+    for(int b = 0; b < NUM_BATCHES; b++)
+        ok = ok && encoder->batches[b].ok;
+    return ok;
+}
+
+/// Compress the waiting blocks all at once, then write them in order.
+/// Blocks are counted on the workers, given code books in order, since a
+/// block may repeat the one before it, then packed on the workers. With a
+/// writer thread the batch is handed to it, and filling continues in the
+/// other batch once the writer is done with it.
+/// @param encoder The subject Block_encoder
+/// @return 1 on success, 0 on a compress or write failure
+static int encode_batch( Block_encoder encoder ){
+    for(int i = 0; encoder->ok && i < encoder->num_ready; i++)
+        if(!encoder->jobs[i].counted)
+            encoder->ok = tp_submit(encoder->pool, count_block, &encoder->jobs[i]);
+    tp_wait(encoder->pool);
+    if(encoder->ok && encoder->options.sample_size > 0 && !encoder->has_book && encoder->num_ready > 0)
+        encoder->ok = build_sample_book(encoder);
+    for(int i = 0; encoder->ok && i < encoder->num_ready; i++){
+        choose_code_book(encoder, &encoder->jobs[i]);
+        encoder->ok = encoder->jobs[i].ok && tp_submit(encoder->pool, encode_block, &encoder->jobs[i]);
+    }
+    tp_wait(encoder->pool);
+    Packman_stats * stats = encoder->options.stats;
+    for(int i = 0; encoder->ok && i < encoder->num_ready; i++){
+        encoder->ok = encoder->jobs[i].ok;
+        if(encoder->ok && stats != NULL)
+            add_block_stats(stats, &encoder->jobs[i]);
+    }
+
+    Block_batch * batch = encoder->batch;
+    batch->num_ready = encoder->ok ? encoder->num_ready : 0;
+    encoder->num_ready = 0;
+    if(encoder->full == NULL){
+        write_batch(encoder, batch);
+        return encoder->ok = encoder->ok && batch->ok;
+    }
+    ring_push(encoder->full, batch);
+    encoder->batch = ring_pop(encoder->empty);
+    encoder->jobs = encoder->batch->jobs;
+    return encoder->ok = encoder->ok && encoder->batch->ok;
+}
+
+/// Find where the statistics of a buffer first change enough to be worth
+/// a new code book. Windows are added to the block while coding the block
+/// and the next window with one code saves less than the header of a new
+/// block would cost.
+/// @param data Input bytes to scan
+/// @param len Number of bytes in data
+/// @param frequencies Set to the symbol counts of the block that is found
+/// @return Number of bytes in the first block
+static size_t find_block_split( const uchar * data, size_t len, uint64_t * frequencies ){
+    size_t cut = len < SPLIT_WINDOW ? len : SPLIT_WINDOW;
+    memset(frequencies, 0, 256 * sizeof(uint64_t));
+    count_frequencies(data, cut, frequencies);
+    double block_bits = entropy_bits(frequencies);
+    while(cut < len){
+        size_t n = len - cut < SPLIT_WINDOW ? len - cut : SPLIT_WINDOW;
+        uint64_t window[256] = { 0 }, joint[256];
+        count_frequencies(data + cut, n, window);
+        for(int symbol = 0; symbol < 256; symbol++)
+            joint[symbol] = frequencies[symbol] + window[symbol];
+        double joint_bits = entropy_bits(joint);
+        if(joint_bits - block_bits - entropy_bits(window) > SPLIT_HEADER_BITS)
+            break;
+        memcpy(frequencies, joint, sizeof(joint));
+        block_bits = joint_bits;
+        cut += n;
+    }
+    return cut;
+}
+
+/// Queue a block, compressing the batch once it is full
+/// @param encoder The subject Block_encoder
+/// @param data Input bytes of the block
+/// @param len Number of bytes in data, at most the block size
+/// @param frequencies Symbol counts of the block, or NULL to count them on a worker
+/// @return 1 on success, 0 on a compress or write failure
+static int queue_block( Block_encoder encoder, const uchar * data, size_t len, const uint64_t * frequencies ){
+    Block_job * job = &encoder->jobs[encoder->num_ready++];
+    job->data = data;
+    job->len = len;
+    job->counted = frequencies != NULL;
+    if(frequencies != NULL)
+        memcpy(job->frequencies, frequencies, sizeof(job->frequencies));
+    if(encoder->num_ready == encoder->num_jobs)
+        return encode_batch(encoder);
+    return encoder->ok;
+}
+
+/// Queue the block being filled by block_encoder_push. In adaptive mode
+/// only the part before its statistics change is queued, and the rest is
+/// moved to the buffer of the next block.
+/// @param encoder The subject Block_encoder
+/// @return 1 on success, 0 on an allocation, compress or write failure
+static int queue_filled( Block_encoder encoder ){
+    Block_job * job = &encoder->jobs[encoder->num_ready];
+    size_t fill = encoder->fill;
+    encoder->fill = 0;
+    if(!encoder->options.adaptive)
+        return queue_block(encoder, job->buf, fill, NULL);
+
+    uint64_t frequencies[256];
+    double start = stats_start(encoder->options.stats);
+    size_t cut = find_block_split(job->buf, fill, frequencies);
+    stats_stop(encoder->options.stats, PACKMAN_PHASE_COUNT, start);
+    if(!queue_block(encoder, job->buf, cut, frequencies) || cut == fill)
+        return encoder->ok;
+
+    // Compressing and writing a job only read its buffer, so the rest can
+    // be copied out after the batch has been handed to the writer
+    Block_job * next = &encoder->jobs[encoder->num_ready];
+    if(next->buf == NULL && (next->buf = malloc(encoder->options.block_size)) == NULL)
+        return encoder->ok = 0;
+    memcpy(next->buf, job->buf + cut, fill - cut);
+    encoder->fill = fill - cut;
+    return encoder->ok;
+}
+
+/// Add one whole block without copying it. Blocks pushed with
+/// block_encoder_push must not be left part filled. In adaptive mode the
+/// data is cut into as many blocks as its statistics call for.
+/// @param encoder The subject Block_encoder
+/// @param data Input bytes of the block, valid until block_encoder_finish returns
+/// @param len Number of bytes in data, at most the block size
+/// @return 1 on success, 0 on a compress or write failure
+int block_encoder_add( Block_encoder encoder, const uchar * data, size_t len ){
+    if(!encoder->ok || encoder->fill > 0 || len > encoder->options.block_size)
+        return encoder->ok = 0;
+    if(!encoder->options.adaptive)
+        return len == 0 || queue_block(encoder, data, len, NULL);
+    while(encoder->ok && len > 0){
+        uint64_t frequencies[256];
+        double start = stats_start(encoder->options.stats);
+        size_t cut = find_block_split(data, len, frequencies);
+        stats_stop(encoder->options.stats, PACKMAN_PHASE_COUNT, start);
+        queue_block(encoder, data, cut, frequencies);
+        data += cut;
+        len -= cut;
+    }
+    return encoder->ok;
+}
+
+/// Copy input into the block being filled, queueing each block as it fills.
+/// In adaptive mode a full block is cut where its statistics change, and
+/// the rest starts the next block.
+/// @param encoder The subject Block_encoder
+/// @param data Input bytes to append
+/// @param len Number of bytes in data
+/// @return 1 on success, 0 on an allocation, compress or write failure
+int block_encoder_push( Block_encoder encoder, const uchar * data, size_t len ){
+    size_t block_size = encoder->options.block_size;
+    while(encoder->ok && len > 0){
+        Block_job * job = &encoder->jobs[encoder->num_ready];
+        if(job->buf == NULL && (job->buf = malloc(block_size)) == NULL)
+            return encoder->ok = 0;
+        size_t n = len < block_size - encoder->fill ? len : block_size - encoder->fill;
+        memcpy(job->buf + encoder->fill, data, n);
+        encoder->fill += n;
+        data += n;
+        len -= n;
+        if(encoder->fill == block_size)
+            queue_filled(encoder);
+    }
+    return encoder->ok;
+}
+
+/// Compress every remaining block and write the end of the file
+/// @param encoder The subject Block_encoder
+/// @return 1 on success, 0 if any block failed to compress or write
+int block_encoder_finish( Block_encoder encoder ){
+    while(encoder->ok && encoder->fill > 0)
+        queue_filled(encoder);
+    uchar end[1] = { BLOCK_END };
+    encoder->ok = encode_batch(encoder) && stop_writer(encoder);
+    return encoder->ok && (encoder->ok = fwrite(end, sizeof(uchar), 1, encoder->out) == 1);
+}
+
+/// Stop the workers and free a block encoder
+/// @param encoder The subject Block_encoder
+/// @post the encoder reference is no longer valid.
+void block_encoder_destroy( Block_encoder encoder ){
+    stop_writer(encoder);
+    if(encoder->pool != NULL)
+        tp_destroy(encoder->pool);
+    for(int b = 0; b < NUM_BATCHES; b++){
+        Block_job * jobs = encoder->batches[b].jobs;
+        for(int i = 0; jobs != NULL && i < encoder->num_jobs; i++){
+            free(jobs[i].buf);
+            free(jobs[i].words);
+        }
+        free(jobs);
+    }
+    free(encoder);
+}
+
+/// Read_chunk is a fixed size piece of input read ahead by the reader thread
+typedef struct Read_chunk_s {
+    uchar * data;           ///< INPUT_BUFSIZE bytes of input
+    size_t len;             ///< number of bytes read, 0 at the end of the input
+} Read_chunk;
+
+/// Reader holds the reader thread of input that isn't mapped, which reads
+/// chunks ahead while the blocks before them are compressed
+typedef struct Reader_s {
+    Input * input;          ///< input to read
+    Read_chunk chunks[READ_CHUNKS];  ///< chunks passed between the threads
+    Ring full;              ///< chunks read, in input order
+    Ring empty;             ///< chunks to read into, or NULL to stop reading
+    pthread_t thread;       ///< thread reading the input
+} Reader;
+
+/// Read chunks of input until its end or until given NULL to read into
+/// @param arg The Reader to fill chunks for
+/// @return NULL
+static void * chunk_reader( void * arg ){
+    Reader * reader = arg;
+    Read_chunk * chunk;
+    while((chunk = ring_pop(reader->empty)) != NULL){
+        chunk->len = input_read(reader->input, chunk->data, INPUT_BUFSIZE);
+        ring_push(reader->full, chunk);
+        if(chunk->len == 0)
+            break;
+    }
+    return NULL;
+}
+
+/// Start reading input ahead on a reader thread
+/// @param reader Reader to start
+/// @param input Input to read
+/// @return 1 on success, 0 on allocation failure or if the thread could not be started
+static int start_reader( Reader * reader, Input * input ){
+    memset(reader, 0, sizeof(Reader));
+    reader->input = input;
+    reader->full = ring_create(READ_CHUNKS);
+    reader->empty = ring_create(READ_CHUNKS + 1);
+    int ok = reader->full != NULL && reader->empty != NULL;
+    for(int i = 0; ok && i < READ_CHUNKS; i++){
+        ok = (reader->chunks[i].data = malloc(INPUT_BUFSIZE)) != NULL;
+        if(ok)
+            ring_push(reader->empty, &reader->chunks[i]);
+    }
+    if(ok && pthread_create(&reader->thread, NULL, chunk_reader, reader) == 0)
+        return 1;
+    for(int i = 0; i < READ_CHUNKS; i++)
+        free(reader->chunks[i].data);
+    if(reader->full != NULL)
+        ring_destroy(reader->full);
+    if(reader->empty != NULL)
+        ring_destroy(reader->empty);
+    return 0;
+}
+
+/// Stop the reader thread, wherever it is in the input, and free its chunks
+/// @param reader Reader to stop
+static void stop_reader( Reader * reader ){
+    ring_push(reader->empty, NULL);
+    pthread_join(reader->thread, NULL);
+    for(int i = 0; i < READ_CHUNKS; i++)
+        free(reader->chunks[i].data);
+    ring_destroy(reader->full);
+    ring_destroy(reader->empty);
+}
+
+/// Encode an input stream as a sequence of independently coded blocks.
+/// Each block gets its own frequency count, code book and code stream,
+/// computed on a pool of worker threads, and blocks are written in order.
+/// Reading, compressing and writing overlap: input that isn't mapped is
+/// read ahead on a reader thread, and each batch of blocks is written on
+/// a writer thread while the next batch is compressed.
+/// @param input Input to encode
+/// @param out Output stream to write the FORMAT_BLOCKS file to
+/// @param options Block size, thread count and code length limit
+/// @return 1 on success, 0 on a read, write or allocation failure
+int encode_blocks( Input * input, FILE * out, const Block_options * options ){
+    Block_encoder encoder = block_encoder_create(out, options);
+    if(encoder == NULL)
+        return 0;
+    start_writer(encoder);
+
+    // Mapped blocks are encoded in place, other input is copied into blocks
+    int ok = 1;
+    Reader reader;
+    if(input->map != NULL){
+        const uchar * data;
+        size_t len;
+        while(ok && (len = input_next(input, options->block_size, &data)) > 0)
+            ok = block_encoder_add(encoder, data, len);
+    } else if((ok = start_reader(&reader, input))){
+        for(;;){
+            double start = stats_start(options->stats);
+            Read_chunk * chunk = ring_pop(reader.full);
+            stats_stop(options->stats, PACKMAN_PHASE_READ, start);
+            if(chunk->len == 0 || !(ok = block_encoder_push(encoder, chunk->data, chunk->len)))
+                break;
+            ring_push(reader.empty, chunk);
+        }
+        stop_reader(&reader);
+    }
+    ok = ok && !input_error(input) && block_encoder_finish(encoder);
+    block_encoder_destroy(encoder);
+    return ok;
+}
+
+/// Read the header of the next block of a FORMAT_BLOCKS file
+/// @param in Input stream positioned at the block's flags byte
+/// @param header Block header to fill
+/// @return 1 on success, 0 on a short read or malformed header
+int read_block_header( FILE * in, Block_header * header ){
+    uchar flags[1];
+    uint num_symbols[1];
+    if(fread(flags, sizeof(uchar), 1, in) != 1)
+        return 0;
+    header->flags = flags[0];
+    if(flags[0] & BLOCK_END)
+        return 1;
+    header->num_streams = flags[0] & BLOCK_INTERLEAVED ? NUM_STREAMS : 1;
+    if(flags[0] & BLOCK_REPEAT){
+        if(!header->has_book)
+            return 0;
+    } else{
+        // The old decode table no longer matches once new code lengths are read
+        release_block_header(header);
+        header->has_book = read_code_lengths(in, header->book.length) && assign_canonical_codes(&header->book);
+        if(!header->has_book)
+            return 0;
+    }
+    if(fread(num_symbols, sizeof(uint), 1, in) != 1
+       || fread(header->num_bits, sizeof(uint64_t), header->num_streams, in) != (size_t) header->num_streams)
+        return 0;
+    header->num_symbols = num_symbols[0];
+    header->num_words = 0;
+    for(int stream = 0; stream < header->num_streams; stream++)
+        header->num_words += bits_to_num_uint(header->num_bits[stream]);
+    return 1;
+}
+
+/// Check the counts of a block header against the block size of its file,
+/// so a corrupt header is caught before its code words are read
+/// @param header Header of a block that isn't the end marker
+/// @param block_size Block size of the file
+/// @return 1 if the symbol and word counts are possible, 0 otherwise
+int block_header_in_bounds( const Block_header * header, uint block_size ){
+    return header->num_symbols <= block_size
+        && header->num_words <= (uint64_t) header->num_symbols * MAX_CODE_LENGTH / BITS_IN_INT + NUM_STREAMS;
+}
+
+/// Free the decode table a block header carries over
+/// @param header Block header to release
+void release_block_header( Block_header * header ){
+    if(header->table != NULL)
+        free_decode_table(header->table);
+    header->table = NULL;
+    header->has_book = 0;
+}
+
+/// Decode the code bits of a block whose header has been read.
+/// Interleaved blocks are read whole, then decoded into a symbol buffer.
+/// @param in Input stream positioned after the block header
+/// @param out Output stream to write the decoded symbols to
+/// @param header Header of the block, keeping its decode table for a repeated code book
+/// @param block_size Block size of the file
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 on a malformed block, read or write failure
+int decode_block( FILE * in, Output * out, Block_header * header, uint block_size, Packman_stats * stats ){
+    double start = stats_start(stats);
+    if(header->table == NULL){
+        if((header->table = create_book_decode_table(&header->book)) == NULL)
+            return 0;
+        if(stats != NULL){
+            stats->num_books++;
+            for(int i = 0; i < 256; i++)
+                if(header->book.length[i] > stats->longest_code)
+                    stats->longest_code = header->book.length[i];
+        }
+        stats_stop(stats, PACKMAN_PHASE_BUILD, start);
+        start = stats_start(stats);
+    }
+    Decode_table table = header->table;
+    int ok;
+    if(header->num_streams == 1){
+        ok = block_header_in_bounds(header, block_size)
+          && header->num_bits[0] <= (uint64_t) header->num_symbols * MAX_CODE_LENGTH;
+        if(ok){
+            Bit_reader br;
+            ok = br_init_stream(&br, in, header->num_words)
+              && decode_stream(&br, header->num_bits[0], table, out) == header->num_symbols && !br.truncated;
+            br_destroy(&br);
+        }
+    } else{
+        // Blocks that fit are decoded straight into the output's buffer
+        uint * words = NULL;
+        uchar * symbols = NULL, * reserved = NULL;
+        ok = block_header_in_bounds(header, block_size)
+          && (words = malloc(header->num_words * sizeof(uint) + 1)) != NULL
+          && fread(words, sizeof(uint), header->num_words, in) == header->num_words;
+        int in_place = ok && output_reserve(out, header->num_symbols, &reserved) >= header->num_symbols;
+        ok = ok && (in_place || (symbols = malloc(header->num_symbols + 1)) != NULL);
+        if(ok){
+            Bit_reader br[NUM_STREAMS];
+            const uint * stream_words = words;
+            for(int stream = 0; stream < NUM_STREAMS; stream++){
+                br_init(&br[stream], stream_words, bits_to_num_uint(header->num_bits[stream]));
+                stream_words += br[stream].num_words;
+            }
+            ok = decode_interleaved(br, header->num_bits, header->num_symbols, table, in_place ? reserved : symbols);
+            if(ok && in_place)
+                output_commit(out, header->num_symbols);
+            else if(ok)
+                ok = output_write(out, symbols, header->num_symbols);
+        }
+        free(words);
+        free(symbols);
+    }
+    stats_stop(stats, PACKMAN_PHASE_DECODE, start);
+    if(ok && stats != NULL){
+        stats->num_blocks++;
+        stats->num_symbols += header->num_symbols;
+        for(int stream = 0; stream < header->num_streams; stream++)
+            stats->code_bits += header->num_bits[stream];
+    }
+    return ok;
+}
+
+/// Decode the blocks of a FORMAT_BLOCKS file
+/// @param in Input stream positioned after the format byte
+/// @param out Output stream to write the decoded symbols to
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 on a malformed block or a write failure
+int decode_blocks( FILE * in, Output * out, Packman_stats * stats ){
+    uint block_size[1];
+    if(fread(block_size, sizeof(uint), 1, in) != 1)
+        return 0;
+    Block_header header;
+    memset(&header, 0, sizeof(header));
+    int ok;
+    while((ok = read_block_header(in, &header)) && !(header.flags & BLOCK_END))
+        if(!(ok = decode_block(in, out, &header, block_size[0], stats)))
+            break;
+    release_block_header(&header);
+    return ok;
+}
+
+/// Encode an input stream as one code stream followed by a block index.
+/// The file header and code lengths must already be written to out.
+/// A sync point is recorded every block_size symbols, then the index and
+/// a footer giving the number of blocks and code bits are appended.
+/// @param input Input to encode
+/// @param out Output stream positioned after the code lengths
+/// @param book Code book shared by every block
+/// @param block_size Number of symbols between sync points
+/// @return 1 on success, 0 on a read, write or allocation failure
+int encode_indexed( Input * input, FILE * out, const Code_book * book, size_t block_size ){
+    Bit_writer bw;
+    size_t capacity = 64;
+    uint64_t num_blocks = 0, out_offset = 0;
+    Index_entry * entries = malloc(capacity * sizeof(Index_entry));
+    if(entries == NULL || !bw_init(&bw, out)){
+        free(entries);
+        return 0;
+    }
+
+    const uchar * data;
+    size_t num_read, in_block = block_size; // the first symbol starts a block
+    int ok = 1;
+    while(ok && (num_read = input_next(input, INPUT_BUFSIZE, &data)) > 0){
+        size_t pos = 0;
+        while(pos < num_read){
+            if(in_block == block_size){ // record a sync point where the next block starts
+                if(num_blocks == capacity){
+                    Index_entry * grown = realloc(entries, 2 * capacity * sizeof(Index_entry));
+                    if(grown == NULL){
+                        ok = 0;
+                        break;
+                    }
+                    entries = grown;
+                    capacity *= 2;
+                }
+                Index_entry entry = { bw.total_bits, out_offset + pos, 0 };
+                entries[num_blocks++] = entry;
+                in_block = 0;
+            }
+            size_t len = num_read - pos < block_size - in_block ? num_read - pos : block_size - in_block;
+            encode_buffer(data + pos, len, book, &bw);
+            entries[num_blocks - 1].num_symbols += len;
+            in_block += len;
+            pos += len;
+        }
+        out_offset += num_read;
+    }
+    ok = ok && !input_error(input) && bw_flush(&bw);
+    uint64_t num_bits = bw.total_bits;
+    bw_destroy(&bw);
+
+    // index, then a fixed size footer so the index can be found from the end
+    for(uint64_t i = 0; ok && i < num_blocks; i++){
+        uint64_t offsets[2] = { entries[i].bit_offset, entries[i].out_offset };
+        uint num_symbols[1] = { entries[i].num_symbols };
+        ok = fwrite(offsets, sizeof(uint64_t), 2, out) == 2
+          && fwrite(num_symbols, sizeof(uint), 1, out) == 1;
+    }
+    uint64_t footer[2] = { num_blocks, num_bits };
+    ok = ok && fwrite(footer, sizeof(uint64_t), 2, out) == 2;
+    free(entries);
+    return ok;
+}
+
+/// Read the block index of a FORMAT_INDEXED file
+/// @param in Input file positioned at the first payload word
+/// @param index Block index to fill
+/// @return 1 on success, 0 on a malformed index or allocation failure
+int read_block_index( FILE * in, Block_index * index ){
+    const off_t entry_size = 2 * sizeof(uint64_t) + sizeof(uint);
+    const off_t footer_size = 2 * sizeof(uint64_t);
+    uint64_t footer[2];
+    index->entries = NULL;
+    index->payload_offset = ftello(in);
+    if(index->payload_offset < 0 || fseeko(in, -footer_size, SEEK_END) != 0
+       || fread(footer, sizeof(uint64_t), 2, in) != 2)
+        return 0;
+    index->num_blocks = footer[0];
+    index->num_bits = footer[1];
+
+    // The index must sit between the end of the payload and the footer
+    off_t footer_offset = ftello(in) - footer_size;
+    off_t payload_end = index->payload_offset + (off_t)(bits_to_num_uint(index->num_bits) * sizeof(uint));
+    if(index->num_blocks == 0 || index->num_blocks > (uint64_t)(footer_offset - payload_end) / entry_size
+       || payload_end + (off_t) index->num_blocks * entry_size != footer_offset
+       || fseeko(in, payload_end, SEEK_SET) != 0)
+        return 0;
+
+    index->entries = malloc(index->num_blocks * sizeof(Index_entry));
+    if(index->entries == NULL)
+        return 0;
+    for(uint64_t i = 0; i < index->num_blocks; i++){
+        uint64_t offsets[2];
+        uint num_symbols[1];
+        if(fread(offsets, sizeof(uint64_t), 2, in) != 2 || fread(num_symbols, sizeof(uint), 1, in) != 1)
+            return 0;
+        // Blocks start at the first bit and the first symbol, and each
+        // starts where the one before it ends
+        const Index_entry * previous = i > 0 ? &index->entries[i - 1] : NULL;
+        uint64_t end_bit = previous != NULL ? previous->bit_offset : 0;
+        uint64_t end_out = previous != NULL ? previous->out_offset + previous->num_symbols : 0;
+        if(offsets[0] < end_bit || offsets[0] > index->num_bits || (i == 0 && offsets[0] != 0)
+           || offsets[1] != end_out)
+            return 0;
+        index->entries[i].bit_offset = offsets[0];
+        index->entries[i].out_offset = offsets[1];
+        index->entries[i].num_symbols = num_symbols[0];
+    }
+
+    // Every symbol takes at least one code bit, so a block has no more
+    // symbols than bits
+    for(uint64_t i = 0; i < index->num_blocks; i++){
+        uint64_t end_bit = i + 1 < index->num_blocks ? index->entries[i + 1].bit_offset : index->num_bits;
+        if(index->entries[i].num_symbols > end_bit - index->entries[i].bit_offset)
+            return 0;
+    }
+    return 1;
+}
+
+/// Read exactly len bytes at an offset of a file
+/// @param fd File descriptor to read from
+/// @param buf Buffer to read into
+/// @param len Number of bytes to read
+/// @param offset File offset to read at
+/// @return 1 on success, 0 on a short read or error
+static int pread_full( int fd, void * buf, size_t len, off_t offset ){
+    while(len > 0){
+        ssize_t num_read = pread(fd, buf, len, offset);
+        if(num_read <= 0)
+            return 0;
+        buf = (char *) buf + num_read;
+        len -= num_read;
+        offset += num_read;
+    }
+    return 1;
+}
+
+/// Index_job holds one block of a FORMAT_INDEXED file while a worker decodes it
+typedef struct Index_job_s {
+    const Block_index * index;  ///< block index of the file
+    Decode_table table;         ///< decode table shared by every block
+    uint64_t block;             ///< index of the block to decode
+    uint num_symbols;           ///< number of symbols to decode from the start of the block
+    int in_fd;                  ///< file descriptor the payload is read from
+    Output * out;               ///< output to write the block in place to, or NULL
+    uint * words;               ///< packed code bits of the block
+    size_t words_capacity;      ///< number of words allocated for words
+    uchar * symbols;            ///< decoded symbols of the block
+    size_t symbols_capacity;    ///< number of bytes allocated for symbols
+    int ok;                     ///< nonzero once the block has been decoded
+} Index_job;
+
+/// Grow a job buffer to hold at least a number of elements
+/// @param buf Buffer to grow
+/// @param capacity Number of elements the buffer holds
+/// @param needed Number of elements needed
+/// @param size Size of one element
+/// @return 1 on success, 0 on allocation failure
+static int reserve( void ** buf, size_t * capacity, size_t needed, size_t size ){
+    if(needed <= *capacity)
+        return 1;
+    free(*buf);
+    *buf = malloc(needed * size);
+    *capacity = *buf == NULL ? 0 : needed;
+    return *buf != NULL;
+}
+
+/// Decode one block of a FORMAT_INDEXED file from its sync point
+/// @param arg The Index_job to decode
+static void decode_index_block( void * arg ){
+    Index_job * job = arg;
+    const Block_index * index = job->index;
+    const Index_entry * entry = &index->entries[job->block];
+    uint64_t end_bit = job->block + 1 < index->num_blocks ? entry[1].bit_offset : index->num_bits;
+    uint64_t first_word = entry->bit_offset / BITS_IN_INT;
+    size_t num_words = bits_to_num_uint(end_bit) - first_word;
+
+    job->ok = reserve((void **) &job->words, &job->words_capacity, num_words, sizeof(uint))
+           && reserve((void **) &job->symbols, &job->symbols_capacity, job->num_symbols, sizeof(uchar))
+           && pread_full(job->in_fd, job->words, num_words * sizeof(uint),
+                         index->payload_offset + (off_t)(first_word * sizeof(uint)));
+    if(!job->ok)
+        return;
+
+    Bit_reader br;
+    br_init(&br, job->words, num_words);
+    br_refill(&br);
+    br_skip(&br, entry->bit_offset % BITS_IN_INT);
+    job->ok = decode_symbols(&br, job->num_symbols, job->table, job->symbols);
+
+    // A whole block must end where the next block starts
+    if(job->ok && job->num_symbols == entry->num_symbols)
+        job->ok = first_word * BITS_IN_INT + br_bits_used(&br) == end_bit;
+    if(job->ok && job->out != NULL)
+        job->ok = output_write_at(job->out, job->symbols, job->num_symbols, entry->out_offset);
+}
+
+/// Decode the blocks of a FORMAT_INDEXED file concurrently.
+/// Each worker reads its block's code bits with pread and, when the output
+/// can be written out of order, writes the decoded symbols at their offset.
+/// Other outputs receive each batch of blocks in order.
+/// @param in Input stream positioned after the code lengths
+/// @param out Output to write the decoded symbols to
+/// @param book Code book shared by every block
+/// @param num_threads Number of worker threads
+/// @return 1 on success, 0 on a malformed block, read or write failure
+int decode_indexed( FILE * in, Output * out, const Code_book * book, int num_threads ){
+    Block_index index = { NULL, 0, 0, 0 };
+    Decode_table table = create_book_decode_table(book);
+    Thread_pool pool = tp_create(num_threads);
+    int ok = table != NULL && pool != NULL && read_block_index(in, &index);
+
+    int in_place = output_positional(out);
+    int num_jobs = pool == NULL ? 0 : tp_num_threads(pool) * BLOCKS_PER_THREAD;
+    Index_job * jobs = calloc(num_jobs, sizeof(Index_job));
+    ok = ok && jobs != NULL;
+
+    for(uint64_t first = 0; ok && first < index.num_blocks; first += num_jobs){
+        int num_batch = index.num_blocks - first < (uint64_t) num_jobs ? (int)(index.num_blocks - first) : num_jobs;
+        for(int i = 0; ok && i < num_batch; i++){
+            jobs[i].index = &index;
+            jobs[i].table = table;
+            jobs[i].block = first + i;
+            jobs[i].num_symbols = index.entries[first + i].num_symbols;
+            jobs[i].in_fd = fileno(in);
+            jobs[i].out = in_place ? out : NULL;
+            ok = tp_submit(pool, decode_index_block, &jobs[i]);
+        }
+        tp_wait(pool);
+        for(int i = 0; ok && i < num_batch; i++){
+            size_t num_symbols = index.entries[first + i].num_symbols;
+            ok = jobs[i].ok
+              && (in_place || output_write(out, jobs[i].symbols, num_symbols));
+        }
+    }
+    if(ok && in_place && index.num_blocks > 0){
+        const Index_entry * last = &index.entries[index.num_blocks - 1];
+        ok = output_skip(out, last->out_offset + last->num_symbols);
+    }
+
+    if(pool != NULL)
+        tp_destroy(pool);
+    for(int i = 0; jobs != NULL && i < num_jobs; i++){
+        free(jobs[i].words);
+        free(jobs[i].symbols);
+    }
+    free(jobs);
+    free(index.entries);
+    free_decode_table(table);
+    return ok;
+}
+
+/// Decode a range of the original file from a FORMAT_INDEXED file.
+/// Only the blocks that overlap the range are read and decoded, and a
+/// block is decoded no further than the end of the range.
+/// A range running past the end of the file is cut short.
+/// @param in Input stream positioned after the code lengths
+/// @param out Output to write the decoded range to
+/// @param book Code book shared by every block
+/// @param offset Offset in the original file of the first byte to decode
+/// @param length Number of bytes to decode
+/// @return 1 on success, 0 on a malformed block, read or write failure
+int decode_range( FILE * in, Output * out, const Code_book * book, uint64_t offset, uint64_t length ){
+    Block_index index = { NULL, 0, 0, 0 };
+    Index_job job = { &index, create_book_decode_table(book), 0, 0, fileno(in), NULL, NULL, 0, NULL, 0, 1 };
+    int ok = job.table != NULL && read_block_index(in, &index);
+    uint64_t end = offset + length < offset ? UINT64_MAX : offset + length;
+
+    // Binary search for the last block starting at or before the offset
+    uint64_t low = 0, high = ok ? index.num_blocks : 0;
+    while(high - low > 1){
+        uint64_t mid = low + (high - low) / 2;
+        if(index.entries[mid].out_offset <= offset)
+            low = mid;
+        else
+            high = mid;
+    }
+
+    for(job.block = low; ok && job.block < index.num_blocks; job.block++){
+        Index_entry * entry = &index.entries[job.block];
+        if(entry->out_offset >= end)
+            break;
+        if(entry->out_offset + entry->num_symbols <= offset)
+            continue;
+
+        // Stop decoding the block once the range is covered
+        uint num_symbols = entry->num_symbols;
+        job.num_symbols = end - entry->out_offset < num_symbols ? (uint)(end - entry->out_offset) : num_symbols;
+        decode_index_block(&job);
+
+        uint64_t first = offset > entry->out_offset ? offset - entry->out_offset : 0;
+        uint64_t last = end - entry->out_offset < num_symbols ? end - entry->out_offset : num_symbols;
+        ok = job.ok && output_write(out, job.symbols + first, last - first);
+    }
+
+    free(job.words);
+    free(job.symbols);
+    free(index.entries);
+    free_decode_table(job.table);
+    return ok;
+}
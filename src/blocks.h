@@ -0,0 +1,206 @@
+//
+// file: blocks.h
+// description: Definition file for block framed files compressed in parallel
+//
+// @author Daniel Tregea
+//
+
+#ifndef BLOCKS_H
+#define BLOCKS_H
+#include <stdio.h>
+#include <sys/types.h>
+#include "packman_utils.h"
+#include "canonical.h"
+#include "input.h"
+#include "libpackman.h"
+#include "output.h"
+
+/// Default number of input bytes per block
+#define DEFAULT_BLOCK_SIZE  ( 4 << 20 )
+
+/// Default largest number of input bytes per block when blocks end where
+/// the symbol statistics change
+#define DEFAULT_ADAPTIVE_BLOCK_SIZE  ( 16 << 20 )
+
+/// Largest number of input bytes per block
+#define MAX_BLOCK_SIZE      ( 1 << 30 )
+
+/// Default number of leading input bytes a sampled encode builds its code book from
+#define DEFAULT_SAMPLE_SIZE  ( 1 << 20 )
+
+/// Block header flags
+enum {
+    BLOCK_INTERLEAVED = 0x01,  ///< the block is coded as NUM_STREAMS interleaved streams
+    BLOCK_REPEAT = 0x02,       ///< the block reuses the previous block's code book; no code lengths follow
+    BLOCK_END = 0x80           ///< no more blocks follow; the header has no other fields
+};
+
+/// Block_options selects how a file is split and compressed
+typedef struct Block_options_s {
+    size_t block_size;  ///< number of input bytes per block
+    int num_threads;    ///< number of worker threads compressing blocks
+    uint max_length;    ///< longest code length allowed, 0 for no limit
+    int interleaved;    ///< nonzero to code each block as NUM_STREAMS streams
+    int adaptive;       ///< nonzero to end blocks where the symbol statistics change,
+                        ///< making block_size the largest block
+    size_t sample_size; ///< leading bytes to build one code book for every block from,
+                        ///< 0 to give each block its own
+    Packman_stats * stats;  ///< timings and counters to add to, or NULL
+} Block_options;
+
+/// Block_header holds the header of one block of a FORMAT_BLOCKS file.
+/// The code book and its decode table carry over to the next block, so one
+/// Block_header, zeroed before the first block, is read for every block of
+/// a file and released after the last.
+typedef struct Block_header_s {
+    uchar flags;                      ///< BLOCK_ flags of the block
+    int has_book;                     ///< nonzero once a block has given a code book
+    Code_book book;                   ///< code book rebuilt from the code lengths
+    struct Decode_table_s * table;    ///< decode table of book, built by decode_block
+    uint num_symbols;                 ///< number of symbols in the block
+    int num_streams;                  ///< 1, or NUM_STREAMS for an interleaved block
+    uint64_t num_bits[NUM_STREAMS];   ///< number of code bits in each stream
+    size_t num_words;                 ///< number of payload words following the header
+} Block_header;
+
+/// Block_encoder compresses blocks in batches on a pool of worker threads
+/// as input arrives, writing each batch in order
+typedef struct block_encoder_s * Block_encoder;
+
+/// Index_entry locates one block of the code stream of a FORMAT_INDEXED file.
+/// Every block shares the file's code book, so a block can be decoded on
+/// its own from its first code bit.
+typedef struct Index_entry_s {
+    uint64_t bit_offset;  ///< offset of the block's first code bit in the payload
+    uint64_t out_offset;  ///< offset of the block's first symbol in the decoded file
+    uint num_symbols;     ///< number of symbols in the block
+} Index_entry;
+
+/// Block_index holds the block index read from the end of a FORMAT_INDEXED file
+typedef struct Block_index_s {
+    Index_entry * entries;  ///< one entry per block, in file order
+    uint64_t num_blocks;    ///< number of entries
+    uint64_t num_bits;      ///< number of code bits in the payload
+    off_t payload_offset;   ///< file offset of the first payload word
+} Block_index;
+
+/// Start a block encoder and write the FORMAT_BLOCKS file header
+/// @param out Output stream to write the file to
+/// @param options Block size, thread count and code length limit
+/// @return a Block_encoder instance, or NULL on allocation or write failure
+Block_encoder block_encoder_create( FILE * out, const Block_options * options );
+
+/// Add one whole block without copying it. Blocks pushed with
+/// block_encoder_push must not be left part filled. In adaptive mode the
+/// data is cut into as many blocks as its statistics call for.
+/// @param encoder The subject Block_encoder
+/// @param data Input bytes of the block, valid until block_encoder_finish returns
+/// @param len Number of bytes in data, at most the block size
+/// @return 1 on success, 0 on a compress or write failure
+int block_encoder_add( Block_encoder encoder, const uchar * data, size_t len );
+
+/// Copy input into the block being filled, queueing each block as it fills.
+/// In adaptive mode a full block is cut where its statistics change, and
+/// the rest starts the next block.
+/// @param encoder The subject Block_encoder
+/// @param data Input bytes to append
+/// @param len Number of bytes in data
+/// @return 1 on success, 0 on an allocation, compress or write failure
+int block_encoder_push( Block_encoder encoder, const uchar * data, size_t len );
+
+/// Compress every remaining block and write the end of the file
+/// @param encoder The subject Block_encoder
+/// @return 1 on success, 0 if any block failed to compress or write
+int block_encoder_finish( Block_encoder encoder );
+
+/// Stop the workers and free a block encoder
+/// @param encoder The subject Block_encoder
+/// @post the encoder reference is no longer valid.
+void block_encoder_destroy( Block_encoder encoder );
+
+/// Encode an input stream as a sequence of independently coded blocks.
+/// Each block gets its own frequency count, code book and code stream,
+/// computed on a pool of worker threads, and blocks are written in order.
+/// In adaptive mode a block grows until a new code book would save more
+/// than the cost of its header.
+/// @param input Input to encode
+/// @param out Output stream to write the FORMAT_BLOCKS file to
+/// @param options Block size, thread count and code length limit
+/// @return 1 on success, 0 on a read, write or allocation failure
+int encode_blocks( Input * input, FILE * out, const Block_options * options );
+
+/// Read the header of the next block of a FORMAT_BLOCKS file
+/// @param in Input stream positioned at the block's flags byte
+/// @param header Header of the previous block, to fill with the next
+/// @return 1 on success, 0 on a short read or malformed header
+int read_block_header( FILE * in, Block_header * header );
+
+/// Check the counts of a block header against the block size of its file,
+/// so a corrupt header is caught before its code words are read
+/// @param header Header of a block that isn't the end marker
+/// @param block_size Block size of the file
+/// @return 1 if the symbol and word counts are possible, 0 otherwise
+int block_header_in_bounds( const Block_header * header, uint block_size );
+
+/// Free the decode table a block header carries over
+/// @param header Block header to release
+void release_block_header( Block_header * header );
+
+/// Decode the code bits of a block whose header has been read.
+/// Interleaved blocks are read whole, then decoded into the output's buffer.
+/// @param in Input stream positioned after the block header
+/// @param out Output to write the decoded symbols to
+/// @param header Header of the block, keeping its decode table for a repeated code book
+/// @param block_size Block size of the file
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 on a malformed block, read or write failure
+int decode_block( FILE * in, Output * out, Block_header * header, uint block_size, Packman_stats * stats );
+
+/// Decode the blocks of a FORMAT_BLOCKS file
+/// @param in Input stream positioned after the format byte
+/// @param out Output to write the decoded symbols to
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 on a malformed block or a write failure
+int decode_blocks( FILE * in, Output * out, Packman_stats * stats );
+
+/// Encode an input stream as one code stream followed by a block index.
+/// The file header and code lengths must already be written to out.
+/// A sync point is recorded every block_size symbols, then the index and
+/// a footer giving the number of blocks and code bits are appended.
+/// @param input Input to encode
+/// @param out Output stream positioned after the code lengths
+/// @param book Code book shared by every block
+/// @param block_size Number of symbols between sync points
+/// @return 1 on success, 0 on a read, write or allocation failure
+int encode_indexed( Input * input, FILE * out, const Code_book * book, size_t block_size );
+
+/// Read the block index of a FORMAT_INDEXED file
+/// @param in Input file positioned at the first payload word
+/// @param index Block index to fill
+/// @return 1 on success, 0 on a malformed index or allocation failure
+int read_block_index( FILE * in, Block_index * index );
+
+/// Decode the blocks of a FORMAT_INDEXED file concurrently.
+/// Each worker reads its block's code bits with pread and, when the output
+/// can be written out of order, writes the decoded symbols at their offset.
+/// Other outputs receive each batch of blocks in order.
+/// @param in Input stream positioned after the code lengths
+/// @param out Output to write the decoded symbols to
+/// @param book Code book shared by every block
+/// @param num_threads Number of worker threads
+/// @return 1 on success, 0 on a malformed block, read or write failure
+int decode_indexed( FILE * in, Output * out, const Code_book * book, int num_threads );
+
+/// Decode a range of the original file from a FORMAT_INDEXED file.
+/// Only the blocks that overlap the range are read and decoded, and a
+/// block is decoded no further than the end of the range.
+/// A range running past the end of the file is cut short.
+/// @param in Input stream positioned after the code lengths
+/// @param out Output to write the decoded range to
+/// @param book Code book shared by every block
+/// @param offset Offset in the original file of the first byte to decode
+/// @param length Number of bytes to decode
+/// @return 1 on success, 0 on a malformed block, read or write failure
+int decode_range( FILE * in, Output * out, const Code_book * book, uint64_t offset, uint64_t length );
+
+#endif
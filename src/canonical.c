@@ -0,0 +1,139 @@
+//
+// file: canonical.c
+// description: Implementation file for canonical huffman code books
+//
+// @author Daniel Tregea
+//
+
+#include <string.h>
+#include "canonical.h"
+
+/// Record the depth of every leaf below a node as its code length
+/// @param node Current node of the tree traversal
+/// @param depth Depth of node in the tree
+/// @param lengths Array of 256 code lengths to fill
+/// @return 1 on success, 0 if a code is longer than MAX_CODE_LENGTH
+static int leaf_depths( const Tree_node node, uint depth, uchar * lengths ){
+    if(node == NULL)
+        return 1;
+    if(node->left == NULL && node->right == NULL){
+        if(depth > MAX_CODE_LENGTH)
+            return 0;
+        lengths[node->sym] = depth == 0 ? 1 : depth; // a lone symbol still needs one bit
+        return 1;
+    }
+    return leaf_depths(node->left, depth + 1, lengths) && leaf_depths(node->right, depth + 1, lengths);
+}
+
+/// Record the depth of every leaf of a huffman tree as its code length
+/// @param tree Head of the huffman tree
+/// @param lengths Array of 256 code lengths to fill
+/// @return 1 on success, 0 if a code is longer than MAX_CODE_LENGTH
+int tree_code_lengths( const Tree_node tree, uchar * lengths ){
+    memset(lengths, 0, 256 * sizeof(uchar));
+    return leaf_depths(tree, 0, lengths);
+}
+
+/// Assign canonical codes to a code book from its code lengths
+/// @param book Code book whose lengths are set
+/// @return 1 on success, 0 if the lengths do not form a prefix code
+int assign_canonical_codes( Code_book * book ){
+    uint count[MAX_CODE_LENGTH + 1] = { 0 };
+    for(int i = 0; i < 256; i++){
+        if(book->length[i] > MAX_CODE_LENGTH)
+            return 0;
+        count[book->length[i]]++;
+    }
+    count[0] = 0;
+
+    // Each length starts where the previous one ended, shifted by one bit.
+    // Codes left over at any length mean an oversubscribed code book.
+    uint64_t next_code[MAX_CODE_LENGTH + 1];
+    uint64_t code = 0, available = 1;
+    for(int len = 1; len <= MAX_CODE_LENGTH; len++){
+        code = (code + count[len - 1]) << 1;
+        next_code[len] = code;
+        available <<= 1;
+        if(count[len] > available)
+            return 0;
+        available -= count[len];
+        if(available > 512) // more room than symbols left, no need to keep counting
+            available = 512;
+    }
+
+    for(int i = 0; i < 256; i++){
+        uchar len = book->length[i];
+        book->code[i] = len > 0 ? next_code[len]++ : 0;
+    }
+    return 1;
+}
+
+/// Determine the number of code bits needed to encode symbols with a code book
+/// @param frequencies Number of occurrences of each of the 256 symbols
+/// @param book Code book of symbol codes
+/// @return Total number of code bits
+uint64_t count_code_bits( const uint64_t * frequencies, const Code_book * book ){
+    uint64_t num_bits = 0;
+    for(int i = 0; i < 256; i++)
+        num_bits += frequencies[i] * book->length[i];
+    return num_bits;
+}
+
+/// Write the code lengths of a code book in compact form.
+/// Only the range of symbols that have codes is stored, two lengths per
+/// byte when every length fits in four bits.
+/// @param ofp Output stream to write to
+/// @param lengths Array of 256 code lengths
+/// @return 1 on success, 0 on write failure
+int write_code_lengths( FILE * ofp, const uchar * lengths ){
+    int first = 0, last = 255;
+    uchar longest = 0;
+    while(first < 255 && lengths[first] == 0)
+        first++;
+    while(last > first && lengths[last] == 0)
+        last--;
+    for(int i = first; i <= last; i++)
+        if(lengths[i] > longest)
+            longest = lengths[i];
+
+    // header: first symbol, last symbol, longest length, then the lengths
+    uchar header[3] = { first, last, longest };
+    uchar packed[256];
+    size_t num_packed = 0;
+    if(longest < 16){
+        for(int i = first; i <= last; i += 2){
+            uchar high = lengths[i], low = i + 1 <= last ? lengths[i + 1] : 0;
+            packed[num_packed++] = (high << 4) | low;
+        }
+    } else {
+        for(int i = first; i <= last; i++)
+            packed[num_packed++] = lengths[i];
+    }
+    return fwrite(header, sizeof(uchar), 3, ofp) == 3
+        && fwrite(packed, sizeof(uchar), num_packed, ofp) == num_packed;
+}
+
+/// Read code lengths written by write_code_lengths
+/// @param fp Input stream to read from
+/// @param lengths Array of 256 code lengths to fill
+/// @return 1 on success, 0 on a short read or malformed header
+int read_code_lengths( FILE * fp, uchar * lengths ){
+    uchar header[3], packed[256];
+    if(fread(header, sizeof(uchar), 3, fp) != 3 || header[0] > header[1] || header[2] > MAX_CODE_LENGTH)
+        return 0;
+    int first = header[0], last = header[1], num_lengths = last - first + 1;
+    size_t num_packed = header[2] < 16 ? (size_t)(num_lengths + 1) / 2 : (size_t) num_lengths;
+    if(fread(packed, sizeof(uchar), num_packed, fp) != num_packed)
+        return 0;
+
+    memset(lengths, 0, 256 * sizeof(uchar));
+    for(int i = 0; i < num_lengths; i++){
+        if(header[2] < 16)
+            lengths[first + i] = i % 2 == 0 ? packed[i / 2] >> 4 : packed[i / 2] & 0x0F;
+        else
+            lengths[first + i] = packed[i];
+        if(lengths[first + i] > header[2])
+            return 0;
+    }
+    return 1;
+}
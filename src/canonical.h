@@ -0,0 +1,57 @@
+//
+// file: canonical.h
+// description: Definition file for canonical huffman code books
+//
+// @author Daniel Tregea
+//
+
+#ifndef CANONICAL_H
+#define CANONICAL_H
+#include <stdio.h>
+#include "packman_utils.h"
+
+/// Code_book holds the code of every symbol as integer bits and a length.
+/// In a canonical code book the codes are fully determined by the lengths:
+/// shorter codes come first, and codes of equal length are consecutive
+/// in symbol order, so only the lengths need to be stored in a file.
+typedef struct Code_book_s {
+    uint64_t code[256];  ///< code bits, right aligned
+    uchar length[256];   ///< number of bits in each code, 0 for absent symbols
+} Code_book;
+
+/// Record the depth of every leaf of a huffman tree as its code length
+/// @param tree Head of the huffman tree
+/// @param lengths Array of 256 code lengths to fill
+/// @return 1 on success, 0 if a code is longer than MAX_CODE_LENGTH
+int tree_code_lengths( const Tree_node tree, uchar * lengths );
+
+/// Assign canonical codes to a code book from its code lengths
+/// @param book Code book whose lengths are set
+/// @return 1 on success, 0 if the lengths do not form a prefix code
+int assign_canonical_codes( Code_book * book );
+
+/// Determine the number of code bits needed to encode symbols with a code book
+/// @param frequencies Number of occurrences of each of the 256 symbols
+/// @param book Code book of symbol codes
+/// @return Total number of code bits
+uint64_t count_code_bits( const uint64_t * frequencies, const Code_book * book );
+
+/// Rough cost of the code lengths write_code_lengths stores for a full
+/// alphabet: three header bytes, then 256 lengths packed two per byte
+#define CODE_LENGTHS_BITS  ( (3 + 128) * 8 )
+
+/// Write the code lengths of a code book in compact form.
+/// Only the range of symbols that have codes is stored, two lengths per
+/// byte when every length fits in four bits.
+/// @param ofp Output stream to write to
+/// @param lengths Array of 256 code lengths
+/// @return 1 on success, 0 on write failure
+int write_code_lengths( FILE * ofp, const uchar * lengths );
+
+/// Read code lengths written by write_code_lengths
+/// @param fp Input stream to read from
+/// @param lengths Array of 256 code lengths to fill
+/// @return 1 on success, 0 on a short read or malformed header
+int read_code_lengths( FILE * fp, uchar * lengths );
+
+#endif
@@ -0,0 +1,221 @@
+#!/bin/sh
+#
+# file: check.sh
+# description: Round trip small generated files through each packman mode
+#              and make sure damaged files are rejected. Run by make check.
+#
+# @author Daniel Tregea
+#
+
+PACKMAN=${PACKMAN:-./packman}
+CHECK_DIR=${CHECK_DIR:-check}
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+failures=0
+checks=0
+
+# Record the result of one check
+# $1: exit status of the check, 0 for a pass
+# $2: description printed if the check failed
+result(){
+    checks=$((checks + 1))
+    if [ "$1" -ne 0 ]; then
+        echo "FAIL: $2"
+        failures=$((failures + 1))
+    fi
+}
+
+# Encode every corpus file with the given options, decode it and compare
+# $@: encode options
+round_trip(){
+    for file in "$TMP"/corpus/*; do
+        rm -f "$TMP/encoded" "$TMP/decoded"
+        $PACKMAN "$@" "$file" "$TMP/encoded" && $PACKMAN "$TMP/encoded" "$TMP/decoded" \
+            && cmp -s "$file" "$TMP/decoded"
+        result $? "round trip of $(basename "$file") [$*]"
+    done
+}
+
+# Encode every corpus file from a pipe to a pipe, then decode it the same way
+# $@: encode options
+pipe_round_trip(){
+    for file in "$TMP"/corpus/*; do
+        cat "$file" | $PACKMAN "$@" - - > "$TMP/encoded" \
+            && cat "$TMP/encoded" | $PACKMAN - - | cmp -s "$file" -
+        result $? "pipe round trip of $(basename "$file") [$*]"
+    done
+}
+
+# Expect packman to fail
+# $1: description of what packman is given
+# $@: the rest of the arguments are packman's
+rejects(){
+    description=$1
+    shift
+    $PACKMAN "$@" > /dev/null 2>&1
+    [ $? -ne 0 ]
+    result $? "$description was accepted"
+}
+
+# Cut bytes off the end of a packman file and expect every cut to be
+# rejected, whether it is read from a file or from a pipe
+# $1: packman file
+# $2: name of the file in failures
+rejects_truncations(){
+    size=$(wc -c < "$1")
+    for cut in 1 3 4 8 100 $((size / 2)) $((size - 3)) $((size - 2)); do
+        [ "$cut" -gt 0 ] && [ "$cut" -lt $((size - 1)) ] || continue
+        head -c $((size - cut)) "$1" > "$TMP/truncated"
+        rejects "$2 cut by $cut bytes" "$TMP/truncated" "$TMP/decoded"
+        cat "$TMP/truncated" | $PACKMAN - - > /dev/null 2>&1
+        [ $? -ne 0 ]
+        result $? "$2 cut by $cut bytes was accepted from a pipe"
+    done
+}
+
+# Encode the text corpus with the given options and expect every
+# truncation of the result to be rejected
+# $@: encode options
+truncated(){
+    $PACKMAN "$@" "$TMP/corpus/text" "$TMP/whole"
+    result $? "encode of text [$*]"
+    rejects_truncations "$TMP/whole" "text [$*]"
+}
+
+# Read one field of the statistics packman -S prints
+# $1: name of the field
+# stdin: statistics
+stats_field(){
+    sed -n "s/.*\"$1\":\([0-9]*\).*/\1/p"
+}
+
+# Generate the corpora: text, skewed bytes, a binary, random bytes, and
+# files of one or two distinct symbols
+mkdir "$TMP/corpus"
+awk 'BEGIN {
+    srand(1)
+    split("the a packman huffman code book block of to and bits symbol tree", words, " ")
+    for(line = 0; line < 2000; line++){
+        n = 4 + int(rand() * 10)
+        for(i = 0; i < n; i++)
+            printf "%s%s", words[1 + int(rand() * 13)], i + 1 < n ? " " : "\n"
+    }
+}' > "$TMP/corpus/text"
+awk 'BEGIN {
+    srand(2)
+    for(i = 0; i < 60000; i++)
+        printf "%c", 97 + int(-log(1 - rand()) * 3) % 26
+}' > "$TMP/corpus/skewed"
+head -c 100000 "$PACKMAN" > "$TMP/corpus/binary"
+head -c 65536 /dev/urandom > "$TMP/corpus/random"
+awk 'BEGIN { for(i = 0; i < 5000; i++) printf "z" }' > "$TMP/corpus/single"
+printf 'ab' > "$TMP/corpus/two"
+printf 'x' > "$TMP/corpus/byte"
+
+# Canonical files, and archives in the original tree format
+round_trip
+truncated
+$PACKMAN "$CHECK_DIR/legacy.pm" "$TMP/legacy" && cmp -s "$CHECK_DIR/legacy.txt" "$TMP/legacy"
+result $? "decode of the 0x80F0 archive"
+rejects_truncations "$CHECK_DIR/legacy.pm" "0x80F0 archive"
+
+# Length limited codes
+round_trip -L 9
+round_trip -L 12
+rejects "a code length limit of 0" -L 0 "$TMP/corpus/text" "$TMP/encoded"
+rejects "8 bit codes for 256 symbols" -L 7 "$TMP/corpus/random" "$TMP/encoded"
+
+# Block mode on a pool of worker threads
+round_trip -b 4K
+round_trip -b 4K -j 4
+truncated -b 4K
+rejects "a block size of 0" -b 0 "$TMP/corpus/text" "$TMP/encoded"
+
+# Indexed files decoded block-parallel
+round_trip -i
+round_trip -i -b 4K -j 4
+truncated -i -b 4K
+
+# Byte ranges of an indexed file, inside a block, across blocks and past the end
+$PACKMAN -i -b 4K "$TMP/corpus/text" "$TMP/indexed"
+result $? "indexed encode for range decodes"
+for range in 0:1 0:100 5000:300 4000:9000 12345:1 20000:100000; do
+    offset=${range%:*}
+    length=${range#*:}
+    $PACKMAN -r "$range" "$TMP/indexed" "$TMP/range" \
+        && tail -c +$((offset + 1)) "$TMP/corpus/text" | head -c "$length" | cmp -s "$TMP/range" -
+    result $? "range decode of $range"
+done
+$PACKMAN -b 4K "$TMP/corpus/text" "$TMP/blocks"
+rejects "a range of a file without an index" -r 0:100 "$TMP/blocks" "$TMP/range"
+
+# Mapped files are read twice; a pipe can only be read once
+pipe_round_trip -b 4K
+cat "$TMP/corpus/text" | $PACKMAN -i - "$TMP/encoded" 2>&1 | grep -q "seekable"
+result $? "indexed encode of a pipe asking for a seekable input"
+
+# Interleaved code streams
+round_trip -4
+round_trip -b 4K -4
+round_trip -i -4
+truncated -4
+
+# Blocks ended where the statistics change
+round_trip -a
+round_trip -a -4
+truncated -a
+
+# Blocks of alike statistics repeat the previous block's code book
+$PACKMAN -S -b 4K "$TMP/corpus/text" "$TMP/encoded" 2> "$TMP/stats"
+[ "$(stats_field code_books < "$TMP/stats")" -lt "$(stats_field blocks < "$TMP/stats")" ]
+result $? "code books repeated across blocks of text"
+
+# Statistics of an encode and a decode
+$PACKMAN -S -L 5 "$TMP/corpus/skewed" "$TMP/encoded" 2> "$TMP/stats"
+[ "$(stats_field bytes_in < "$TMP/stats")" -eq "$(wc -c < "$TMP/corpus/skewed")" ] \
+    && [ "$(stats_field bytes_out < "$TMP/stats")" -eq "$(wc -c < "$TMP/encoded")" ] \
+    && [ "$(stats_field longest_code < "$TMP/stats")" -le 5 ]
+result $? "encode statistics"
+$PACKMAN -S "$TMP/encoded" "$TMP/decoded" 2> "$TMP/stats"
+[ "$(stats_field symbols < "$TMP/stats")" -eq "$(wc -c < "$TMP/corpus/skewed")" ]
+result $? "decode statistics"
+$PACKMAN -s "$TMP/encoded" "$TMP/decoded" 2>&1 | grep -q "^total"
+result $? "human readable statistics"
+
+# Output written with direct I/O where the file system allows it
+$PACKMAN -b 4K "$TMP/corpus/binary" "$TMP/encoded" && $PACKMAN -d "$TMP/encoded" "$TMP/decoded" \
+    && cmp -s "$TMP/corpus/binary" "$TMP/decoded"
+result $? "direct decode of binary"
+
+# Pipes read on a reader thread ahead of the block encoders
+pipe_round_trip -b 4K -j 4
+pipe_round_trip -b 4K -4
+pipe_round_trip -a
+
+# Code books built from a sample, and pipes encoded in one pass
+round_trip -p 1K
+truncated -p 1K
+pipe_round_trip
+pipe_round_trip -L 9
+
+# Dynamic files, coded with a code book both sides rebuild
+round_trip -y
+round_trip -y -L 8
+pipe_round_trip -y
+truncated -y
+rejects "a dynamic code length limit of 7" -y -L 7 "$TMP/corpus/text" "$TMP/encoded"
+for option in -b4K -i -4 -a -p1K -c; do
+    rejects "dynamic mode with $option" -y $option "$TMP/corpus/text" "$TMP/encoded"
+done
+
+# Context files, with a code book per previous byte
+round_trip -c
+round_trip -c -L 11
+truncated -c
+for option in -b4K -i -4 -a -p1K; do
+    rejects "context mode with $option" -c $option "$TMP/corpus/text" "$TMP/encoded"
+done
+
+echo "$((checks - failures)) of $checks checks passed"
+[ "$failures" -eq 0 ]
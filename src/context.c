@@ -0,0 +1,283 @@
+//
+// file: context.c
+// description: Implementation file for files coded with a code book per previous byte
+//
+// @author Daniel Tregea
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "context.h"
+#include "bitio.h"
+#include "canonical.h"
+#include "decode.h"
+#include "encode.h"
+#include "histogram.h"
+#include "stats.h"
+#include "utilities.h"
+
+/// Counts below this have count * log2(count) looked up while clustering
+#define CONTEXT_LOG_TABLE  ( 1 << 16 )
+
+/// Context_clusters holds the state of grouping previous bytes into code books
+typedef struct Context_clusters_s {
+    uint64_t (*counts)[256];  ///< symbol counts after each previous byte; a cluster's are summed into its root's
+    double * xlogx;           ///< count * log2(count) for each count below CONTEXT_LOG_TABLE
+    double (*merge_bits)[256];  ///< code bits merging two clusters adds, indexed by their roots
+    double bits[256];         ///< estimated code bits of each cluster, indexed by its root
+    uchar root[256];          ///< root of the cluster each previous byte is in
+    int active[256];          ///< nonzero for the root of each cluster
+} Context_clusters;
+
+/// Look up or compute count * log2(count)
+/// @param clusters Clusters holding the lookup table
+/// @param count Count, 0 giving 0
+/// @return count * log2(count)
+static double xlogx( const Context_clusters * clusters, uint64_t count ){
+    return count < CONTEXT_LOG_TABLE ? clusters->xlogx[count] : count * log2_count(count);
+}
+
+/// Estimate the code bits of one or two clusters' symbols under one code
+/// book: their entropy, but at least one bit per symbol as a huffman code needs
+/// @param clusters Clusters holding the lookup table
+/// @param first Symbol counts of a cluster
+/// @param second Symbol counts of a cluster to add to first, or NULL
+/// @return Estimated number of code bits
+static double cluster_bits( const Context_clusters * clusters, const uint64_t * first, const uint64_t * second ){
+    uint64_t total = 0;
+    double sum = 0;
+    for(int symbol = 0; symbol < 256; symbol++){
+        uint64_t count = first[symbol] + (second != NULL ? second[symbol] : 0);
+        if(count > 0){
+            total += count;
+            sum += xlogx(clusters, count);
+        }
+    }
+    double bits = xlogx(clusters, total) - sum;
+    return bits < total ? total : bits;
+}
+
+/// Record the code bits merging two clusters adds
+/// @param clusters The subject Context_clusters
+/// @param first Root of a cluster
+/// @param second Root of another cluster
+static void price_merge( Context_clusters * clusters, int first, int second ){
+    double bits = cluster_bits(clusters, clusters->counts[first], clusters->counts[second])
+                - clusters->bits[first] - clusters->bits[second];
+    clusters->merge_bits[first][second] = clusters->merge_bits[second][first] = bits;
+}
+
+/// Group previous bytes into code books. Every previous byte that occurs
+/// starts as its own cluster, and the two clusters whose merge costs the
+/// fewest code bits are merged while that costs less than the code lengths
+/// of the book it saves. Previous bytes that never occur use book 0.
+/// @param counts Symbol counts after each previous byte, summed into each cluster's root on return
+/// @param book_of Set to the code book of each previous byte
+/// @param roots Set to the previous byte whose counts each code book is built from
+/// @return Number of code books, 0 if there are no symbols or on allocation failure
+static int cluster_contexts( uint64_t (*counts)[256], uchar * book_of, uchar * roots ){
+    Context_clusters clusters;
+    clusters.counts = counts;
+    clusters.xlogx = malloc(CONTEXT_LOG_TABLE * sizeof(double));
+    clusters.merge_bits = malloc(256 * sizeof(*clusters.merge_bits));
+    if(clusters.xlogx == NULL || clusters.merge_bits == NULL){
+        free(clusters.xlogx);
+        free(clusters.merge_bits);
+        return 0;
+    }
+    clusters.xlogx[0] = 0;
+    for(uint64_t count = 1; count < CONTEXT_LOG_TABLE; count++)
+        clusters.xlogx[count] = count * log2_count(count);
+
+    for(int context = 0; context < 256; context++){
+        clusters.root[context] = (uchar) context;
+        clusters.active[context] = 0;
+        for(int symbol = 0; symbol < 256 && !clusters.active[context]; symbol++)
+            clusters.active[context] = counts[context][symbol] > 0;
+        if(clusters.active[context])
+            clusters.bits[context] = cluster_bits(&clusters, counts[context], NULL);
+    }
+    for(int first = 0; first < 256; first++)
+        for(int second = first + 1; second < 256; second++)
+            if(clusters.active[first] && clusters.active[second])
+                price_merge(&clusters, first, second);
+
+    // Merge the cheapest pair until no merge pays for itself
+    for(;;){
+        int best_first = -1, best_second = -1;
+        double best = CODE_LENGTHS_BITS;
+        for(int first = 0; first < 256; first++){
+            if(!clusters.active[first])
+                continue;
+            for(int second = first + 1; second < 256; second++){
+                if(clusters.active[second] && clusters.merge_bits[first][second] < best){
+                    best = clusters.merge_bits[first][second];
+                    best_first = first;
+                    best_second = second;
+                }
+            }
+        }
+        if(best_first < 0)
+            break;
+        for(int symbol = 0; symbol < 256; symbol++)
+            counts[best_first][symbol] += counts[best_second][symbol];
+        clusters.active[best_second] = 0;
+        clusters.bits[best_first] = cluster_bits(&clusters, counts[best_first], NULL);
+        for(int context = 0; context < 256; context++)
+            if(clusters.root[context] == best_second)
+                clusters.root[context] = (uchar) best_first;
+        for(int other = 0; other < 256; other++)
+            if(clusters.active[other] && other != best_first)
+                price_merge(&clusters, best_first, other);
+    }
+
+    // Number the clusters in order of their roots
+    int num_books = 0;
+    uchar book_of_root[256] = { 0 };
+    for(int context = 0; context < 256; context++){
+        if(clusters.active[context]){
+            book_of_root[context] = (uchar) num_books;
+            roots[num_books++] = (uchar) context;
+        }
+    }
+    for(int context = 0; context < 256; context++)
+        book_of[context] = book_of_root[clusters.root[context]];
+    free(clusters.xlogx);
+    free(clusters.merge_bits);
+    return num_books;
+}
+
+/// Encode an input stream with an order-1 model: each symbol is coded with
+/// the code book of the byte before it. Previous bytes whose statistics are
+/// alike share a code book, so a file stores only as many code lengths as
+/// pay for themselves. The input is read twice, once to count and once to
+/// encode.
+/// @param input Input to encode, which must be seekable
+/// @param out Output stream to write the FORMAT_CONTEXT file to
+/// @param max_length Longest code length allowed, 0 for no limit
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 on a read, write or allocation failure, or an empty input
+int encode_context( Input * input, FILE * out, uint max_length, Packman_stats * stats ){
+    uint64_t (*counts)[256] = calloc(256, sizeof(*counts));
+    Code_book * books = malloc(CONTEXT_MAX_BOOKS * sizeof(Code_book));
+    if(counts == NULL || books == NULL){
+        free(counts);
+        free(books);
+        return 0;
+    }
+
+    // Count each symbol after each previous byte; the first symbol follows symbol 0
+    double start = stats_start(stats);
+    const uchar * data;
+    size_t len;
+    uchar previous = 0;
+    while((len = input_next(input, SIZE_MAX, &data)) > 0)
+        count_context_frequencies(data, len, &previous, counts);
+    int ok = !input_error(input);
+    stats_stop(stats, PACKMAN_PHASE_COUNT, start);
+
+    // Group previous bytes, then build a code book per group
+    start = stats_start(stats);
+    uchar book_of[256], roots[CONTEXT_MAX_BOOKS];
+    int num_books = ok ? cluster_contexts(counts, book_of, roots) : 0;
+    ok = num_books > 0;
+    uint64_t num_symbols[1] = { 0 }, num_bits[1] = { 0 };
+    for(int book = 0; ok && book < num_books; book++){
+        ok = build_code_book(counts[roots[book]], max_length, &books[book]);
+        for(int symbol = 0; ok && symbol < 256; symbol++)
+            num_symbols[0] += counts[roots[book]][symbol];
+        num_bits[0] += ok ? count_code_bits(counts[roots[book]], &books[book]) : 0;
+        if(ok && stats != NULL){
+            stats->num_books++;
+            for(int symbol = 0; symbol < 256; symbol++)
+                if(books[book].length[symbol] > stats->longest_code)
+                    stats->longest_code = books[book].length[symbol];
+        }
+    }
+    stats_stop(stats, PACKMAN_PHASE_BUILD, start);
+
+    // Book count, book of each previous byte, code lengths, then one code stream
+    start = stats_start(stats);
+    ushort count[1] = { (ushort) num_books };
+    ok = ok && input_rewind(input) && write_container_header(out, FORMAT_CONTEXT)
+      && fwrite(count, sizeof(ushort), 1, out) == 1 && fwrite(book_of, sizeof(uchar), 256, out) == 256;
+    for(int book = 0; ok && book < num_books; book++)
+        ok = write_code_lengths(out, books[book].length);
+    ok = ok && fwrite(num_symbols, sizeof(uint64_t), 1, out) == 1 && fwrite(num_bits, sizeof(uint64_t), 1, out) == 1;
+
+    Bit_writer bw;
+    if(ok && (ok = bw_init(&bw, out))){
+        const Code_book * context_books[256];
+        for(int context = 0; context < 256; context++)
+            context_books[context] = &books[book_of[context]];
+        previous = 0;
+        while(!bw.error && (len = input_next(input, INPUT_BUFSIZE, &data)) > 0)
+            encode_context_buffer(data, len, context_books, &previous, &bw);
+        ok = !input_error(input) && bw_flush(&bw);
+        bw_destroy(&bw);
+    }
+    stats_stop(stats, PACKMAN_PHASE_ENCODE, start);
+    if(ok && stats != NULL){
+        stats->num_symbols += num_symbols[0];
+        stats->code_bits += num_bits[0];
+    }
+    free(counts);
+    free(books);
+    return ok;
+}
+
+/// Decode a FORMAT_CONTEXT file with a decode table per code book
+/// @param in Input stream positioned after the format byte
+/// @param out Output to write the decoded symbols to
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 on a malformed file, allocation or write failure
+int decode_context( FILE * in, Output * out, Packman_stats * stats ){
+    double start = stats_start(stats);
+    ushort count[1];
+    uchar book_of[256];
+    if(fread(count, sizeof(ushort), 1, in) != 1 || count[0] < 1 || count[0] > CONTEXT_MAX_BOOKS
+       || fread(book_of, sizeof(uchar), 256, in) != 256)
+        return 0;
+    int num_books = count[0];
+    for(int context = 0; context < 256; context++)
+        if(book_of[context] >= num_books)
+            return 0;
+
+    Decode_table tables[CONTEXT_MAX_BOOKS] = { NULL };
+    Code_book * book = malloc(sizeof(Code_book));
+    int ok = book != NULL;
+    for(int i = 0; ok && i < num_books; i++){
+        ok = read_code_lengths(in, book->length) && assign_canonical_codes(book)
+          && (tables[i] = create_book_decode_table(book)) != NULL;
+        if(ok && stats != NULL){
+            stats->num_books++;
+            for(int symbol = 0; symbol < 256; symbol++)
+                if(book->length[symbol] > stats->longest_code)
+                    stats->longest_code = book->length[symbol];
+        }
+    }
+    free(book);
+    stats_stop(stats, PACKMAN_PHASE_BUILD, start);
+
+    start = stats_start(stats);
+    uint64_t num_symbols[1], num_bits[1];
+    ok = ok && fread(num_symbols, sizeof(uint64_t), 1, in) == 1 && fread(num_bits, sizeof(uint64_t), 1, in) == 1;
+    if(ok){
+        Decode_table context_tables[256];
+        for(int context = 0; context < 256; context++)
+            context_tables[context] = tables[book_of[context]];
+        Bit_reader br;
+        ok = br_init_stream(&br, in, bits_to_num_uint(num_bits[0]))
+          && decode_context_stream(&br, num_symbols[0], num_bits[0], context_tables, out) && !br.truncated;
+        br_destroy(&br);
+    }
+    stats_stop(stats, PACKMAN_PHASE_DECODE, start);
+    if(ok && stats != NULL){
+        stats->num_symbols += num_symbols[0];
+        stats->code_bits += num_bits[0];
+    }
+    for(int i = 0; i < num_books; i++)
+        if(tables[i] != NULL)
+            free_decode_table(tables[i]);
+    return ok;
+}
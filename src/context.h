@@ -0,0 +1,38 @@
+//
+// file: context.h
+// description: Definition file for files coded with a code book per previous byte
+//
+// @author Daniel Tregea
+//
+
+#ifndef CONTEXT_H
+#define CONTEXT_H
+#include <stdio.h>
+#include "packman_utils.h"
+#include "input.h"
+#include "libpackman.h"
+#include "output.h"
+
+/// Largest number of code books of a FORMAT_CONTEXT file, one per previous byte
+#define CONTEXT_MAX_BOOKS  256
+
+/// Encode an input stream with an order-1 model: each symbol is coded with
+/// the code book of the byte before it. Previous bytes whose statistics are
+/// alike share a code book, so a file stores only as many code lengths as
+/// pay for themselves. The input is read twice, once to count and once to
+/// encode.
+/// @param input Input to encode, which must be seekable
+/// @param out Output stream to write the FORMAT_CONTEXT file to
+/// @param max_length Longest code length allowed, 0 for no limit
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 on a read, write or allocation failure, or an empty input
+int encode_context( Input * input, FILE * out, uint max_length, Packman_stats * stats );
+
+/// Decode a FORMAT_CONTEXT file with a decode table per code book
+/// @param in Input stream positioned after the format byte
+/// @param out Output to write the decoded symbols to
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 on a malformed file, allocation or write failure
+int decode_context( FILE * in, Output * out, Packman_stats * stats );
+
+#endif
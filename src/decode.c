@@ -11,51 +11,347 @@
 #include "utilities.h"
 #include "decode.h"
 
-/// Get each bit from an unsigned integer array to be put in a string array
-/// @param num_bits Number of bits in encoded_binary
-/// @param encoded_binary Array of unsigned integers
-/// @return Array of strings each holding a bit from encoded_binary
-char ** uint_to_str_bits( uint num_bits, uint * encoded_binary ){
-    char ** bits = malloc(num_bits * sizeof(char *));
-    for(uint i = 0; i < num_bits; i++)
-        bits[i] = (encoded_binary[get_byte_index(i)] & get_mask(i)) != 0 ? "1" : "0";
-    return bits;
-}
-
-/// Decode and write each bit from a string array
-/// @param bits String array holding binary sequence to be decoded
-/// @param num_bits Number of bits in bit array
-/// @param lut Look up table
-/// @param fp Output stream to write to
-/// @return Method success or realloc failure
-int write_bits( char ** bits, uint num_bits, char ** lut, FILE * fp ){
-    // Read each char bit and write symbols as their code is read
-    char * cur_code = NULL;
-    for(uint i = 0; i < num_bits; i++){
-        // Add the new bit to the current code
-        if(cur_code == NULL){
-            cur_code = malloc(2 * sizeof(char));
-            strcpy(cur_code, bits[i]);
-        } else {
-            cur_code = realloc(cur_code, strlen(cur_code) + 2);
-            if(cur_code == NULL)
-                return -1;
-            cur_code = strcat(cur_code, bits[i]);
+/// Code_item holds one symbol code while the decode table is built
+typedef struct Code_item_s {
+    uint64_t aligned;  ///< code bits left aligned in 64 bits
+    uchar length;      ///< number of bits in the code
+    uchar sym;         ///< symbol the code decodes to
+} Code_item;
+
+/// Collect the code of every leaf of a huffman tree
+/// @param node Current node of the tree traversal
+/// @param code Code bits generated by the traversal so far
+/// @param depth Number of bits in code
+/// @param items Array to append codes to
+/// @param num_items Number of codes in items
+/// @return 1 on success, 0 if a code is longer than MAX_CODE_LENGTH
+static int collect_codes( const Tree_node node, uint64_t code, uint depth, Code_item * items, uint * num_items ){
+    if(node == NULL)
+        return 1;
+    if(node->left == NULL && node->right == NULL){
+        if(depth == 0) // a tree of one symbol still needs one bit per symbol
+            depth = 1;
+        if(depth > MAX_CODE_LENGTH)
+            return 0;
+        items[*num_items].aligned = code << (64 - depth);
+        items[*num_items].length = depth;
+        items[*num_items].sym = node->sym;
+        (*num_items)++;
+        return 1;
+    }
+    return collect_codes(node->left, code << 1, depth + 1, items, num_items)
+        && collect_codes(node->right, (code << 1) | 1, depth + 1, items, num_items);
+}
+
+/// Ordering function for sorting codes by their left aligned bits
+/// @param lhs Code to be compared to rhs
+/// @param rhs Code to be compared to lhs
+/// @return Negative, zero or positive as lhs sorts before, with or after rhs
+static int compare_code_items( const void * lhs, const void * rhs ){
+    const Code_item * left = lhs, * right = rhs;
+    if(left->aligned != right->aligned)
+        return left->aligned < right->aligned ? -1 : 1;
+    return (int)left->length - (int)right->length;
+}
+
+/// Reserve space for a new level at the end of a decode table
+/// @param table Decode table to grow
+/// @param num_entries Number of entries in the new level
+/// @return Offset of the new level, or 0 on allocation failure
+static uint alloc_level( Decode_table table, uint num_entries ){
+    if(table->size + num_entries > table->capacity){
+        uint capacity = table->capacity * 2;
+        while(capacity < table->size + num_entries)
+            capacity *= 2;
+        Decode_entry * entries = realloc(table->entries, capacity * sizeof(Decode_entry));
+        if(entries == NULL)
+            return 0;
+        table->entries = entries;
+        table->capacity = capacity;
+    }
+    uint offset = table->size;
+    memset(table->entries + offset, 0, num_entries * sizeof(Decode_entry));
+    table->size += num_entries;
+    return offset;
+}
+
+/// Fill one level of a decode table from a sorted run of codes
+/// @param table Decode table being built
+/// @param offset Offset of the level within the table
+/// @param width Number of bits the level is indexed by
+/// @param items Codes sharing the prefix that leads to this level, sorted
+/// @param num_items Number of codes in items
+/// @param consumed Number of code bits resolved before this level
+/// @return 1 on success, 0 on allocation failure
+static int build_level( Decode_table table, uint offset, uint width, const Code_item * items, uint num_items, uint consumed ){
+    uint i = 0;
+    while(i < num_items){
+        uint index = (uint)((items[i].aligned << consumed) >> (64 - width));
+        uint remaining = items[i].length - consumed;
+
+        if(remaining <= width){ // code ends at this level, fill every entry it prefixes
+            Decode_entry entry = { items[i].sym, remaining, DECODE_SYMBOL };
+            uint first = offset + index, last = first + (1u << (width - remaining));
+            for(uint j = first; j < last; j++)
+                table->entries[j] = entry;
+            i++;
+            continue;
+        }
+
+        // Codes longer than this level share an entry that points to a sub table
+        uint end = i, longest = 0;
+        while(end < num_items && (uint)((items[end].aligned << consumed) >> (64 - width)) == index){
+            if(items[end].length - consumed - width > longest)
+                longest = items[end].length - consumed - width;
+            end++;
+        }
+        uint sub_width = longest < DECODE_SUB_BITS ? longest : DECODE_SUB_BITS;
+        uint sub_offset = alloc_level(table, 1u << sub_width);
+        if(sub_offset == 0)
+            return 0;
+        Decode_entry entry = { sub_offset, sub_width, DECODE_SUBTABLE };
+        table->entries[offset + index] = entry;
+        if(!build_level(table, sub_offset, sub_width, items + i, end - i, consumed + width))
+            return 0;
+        i = end;
+    }
+    return 1;
+}
+
+/// Build a multi level decode table from a set of prefix codes
+/// @param items Codes of every symbol, reordered by this function
+/// @param num_items Number of codes in items
+/// @return Decode table, or NULL on allocation failure
+static Decode_table build_decode_table( Code_item * items, uint num_items ){
+    qsort(items, num_items, sizeof(Code_item), compare_code_items);
+
+    uint longest = 0;
+    for(uint i = 0; i < num_items; i++)
+        if(items[i].length > longest)
+            longest = items[i].length;
+
+    Decode_table table = malloc(sizeof(struct Decode_table_s));
+    if(table == NULL)
+        return NULL;
+    table->root_bits = longest < DECODE_ROOT_BITS ? longest : DECODE_ROOT_BITS;
+    table->capacity = 2u << DECODE_ROOT_BITS;
+    table->size = 1u << table->root_bits; // root table sits at offset 0
+    table->entries = calloc(table->capacity, sizeof(Decode_entry));
+    if(table->entries == NULL || !build_level(table, 0, table->root_bits, items, num_items, 0)){
+        free_decode_table(table);
+        return NULL;
+    }
+    return table;
+}
+
+/// Build a multi level decode table from the codes of a huffman tree
+/// @param tree Head of the huffman tree
+/// @return Decode table, or NULL if the tree is empty or too deep
+Decode_table create_decode_table( const Tree_node tree ){
+    Code_item items[256];
+    uint num_items = 0;
+    if(tree == NULL || !collect_codes(tree, 0, 0, items, &num_items))
+        return NULL;
+    return build_decode_table(items, num_items);
+}
+
+/// Build a multi level decode table from the codes of a code book
+/// @param book Code book with codes assigned
+/// @return Decode table, or NULL if the code book is empty
+Decode_table create_book_decode_table( const Code_book * book ){
+    Code_item items[256];
+    uint num_items = 0;
+    for(int i = 0; i < 256; i++){
+        if(book->length[i] == 0)
+            continue;
+        items[num_items].aligned = book->code[i] << (64 - book->length[i]);
+        items[num_items].length = book->length[i];
+        items[num_items].sym = i;
+        num_items++;
+    }
+    if(num_items == 0)
+        return NULL;
+    return build_decode_table(items, num_items);
+}
+
+/// Free a decode table
+/// @param table Decode table to free
+void free_decode_table( Decode_table table ){
+    if(table == NULL)
+        return;
+    free(table->entries);
+    free(table);
+}
+
+/// Decode a symbol whose code is longer than the root table by following
+/// its sub tables
+/// @param br Bit reader positioned at the first bit of a code
+/// @param table Decode table for the code stream
+/// @param entry Root table entry the code's first bits select
+/// @param sym Set to the decoded symbol
+/// @return Number of code bits consumed, or 0 on a code missing from the table
+static uint decode_long_symbol( Bit_reader * br, const Decode_table table, Decode_entry entry, uchar * sym ){
+    uint width = table->root_bits, used = 0;
+    while(entry.kind == DECODE_SUBTABLE){
+        br_skip(br, width);
+        used += width;
+        br_refill(br);
+        width = entry.bits;
+        entry = table->entries[entry.value + br_peek(br, width)];
+    }
+    if(entry.kind == DECODE_INVALID)
+        return 0;
+    br_skip(br, entry.bits);
+    *sym = (uchar) entry.value;
+    return used + entry.bits;
+}
+
+/// Decode the next symbol from a bit reader.
+/// Up to DECODE_ROOT_BITS of the code are resolved with one lookup,
+/// following sub tables only for the rare longer codes.
+/// @param br Bit reader positioned at the first bit of a code
+/// @param table Decode table for the code stream
+/// @param sym Set to the decoded symbol
+/// @return Number of code bits consumed, or 0 on a code missing from the table
+static inline uint decode_symbol( Bit_reader * br, const Decode_table table, uchar * sym ){
+    br_refill(br);
+    Decode_entry entry = table->entries[br_peek(br, table->root_bits)];
+    if(entry.kind != DECODE_SYMBOL)
+        return decode_long_symbol(br, table, entry, sym);
+    br_skip(br, entry.bits);
+    *sym = (uchar) entry.value;
+    return entry.bits;
+}
+
+/// Decode code bits from a bit reader straight into an output's buffer
+/// @param br Bit reader positioned at the first code bit
+/// @param num_bits Number of code bits to decode
+/// @param table Decode table built from the huffman tree or code book
+/// @param out Output to write to
+/// @return Number of symbols decoded, 0 on a code missing from the table or a write failure
+uint64_t decode_stream( Bit_reader * br, uint64_t num_bits, Decode_table table, Output * out ){
+    uint64_t remaining = num_bits, num_symbols = 0;
+    while(remaining > 0){
+        uchar * symbols;
+        size_t room = output_reserve(out, OUTPUT_BUFSIZE, &symbols);
+        if(room == 0)
+            return 0;
+        size_t len = 0;
+        for(; len < room && remaining > 0; len++){
+            uint used = decode_symbol(br, table, &symbols[len]);
+            if(used == 0 || used > remaining)
+                return 0;
+            remaining -= used;
         }
-        
-        // Determine if the newly added bit generates a code from the look up table
-        for(int j = 0; j < 256; j++){
-            if(lut[j] != NULL && strcmp(cur_code, lut[j]) == 0){
-                // If a symbols code is generated, write it to the file
-                char * data = malloc(sizeof(char));
-                data[0] = (char) j;
-                fwrite(data, sizeof(char), 1, fp);
-                free(data);
-                free(cur_code);
-                cur_code = NULL; // sanity check
-                j = 256; // End loop on symbols code being found
+        output_commit(out, len);
+        num_symbols += len;
+    }
+    return num_symbols;
+}
+
+/// Decode symbols each coded with the decode table of the symbol before
+/// it, straight into an output's buffer. The first symbol follows symbol 0.
+/// @param br Bit reader positioned at the first code bit
+/// @param num_symbols Number of symbols to decode
+/// @param num_bits Number of code bits the symbols use
+/// @param tables Decode table of each of the 256 previous symbols
+/// @param out Output to write to
+/// @return 1 on success, 0 on a missing code, a stream of the wrong length or a write failure
+int decode_context_stream( Bit_reader * br, uint64_t num_symbols, uint64_t num_bits, const Decode_table * tables, Output * out ){
+    // Work on a local copy so stores to the output can't alias the reader's state,
+    // and keep each context's root table at hand so choosing it is one load
+    Bit_reader local = *br;
+    const Decode_entry * roots[256];
+    uchar root_bits[256];
+    for(int context = 0; context < 256; context++){
+        roots[context] = tables[context]->entries;
+        root_bits[context] = tables[context]->root_bits;
+    }
+    uint64_t used = 0;
+    uchar prev = 0;
+    int ok = 1;
+    while(ok && num_symbols > 0){
+        uchar * symbols;
+        size_t room = output_reserve(out, OUTPUT_BUFSIZE, &symbols);
+        if(room == 0)
+            return 0;
+        size_t len = 0, want = room < num_symbols ? room : num_symbols;
+        for(; len < want; len++){
+            br_refill(&local);
+            Decode_entry entry = roots[prev][br_peek(&local, root_bits[prev])];
+            uint bits = entry.bits;
+            if(entry.kind == DECODE_SYMBOL){
+                br_skip(&local, bits);
+                prev = (uchar) entry.value;
+            } else if((bits = decode_long_symbol(&local, tables[prev], entry, &prev)) == 0){
+                ok = 0;
+                break;
             }
+            used += bits;
+            symbols[len] = prev;
         }
+        output_commit(out, len);
+        num_symbols -= len;
+    }
+    *br = local;
+    return ok && used == num_bits;
+}
+
+/// Decode a known number of symbols from a bit reader into a buffer
+/// @param br Bit reader positioned at the first code bit
+/// @param num_symbols Number of symbols to decode
+/// @param table Decode table for the code stream
+/// @param out Buffer of at least num_symbols bytes
+/// @return 1 on success, 0 on a code missing from the table
+int decode_symbols( Bit_reader * br, size_t num_symbols, Decode_table table, uchar * out ){
+    for(size_t i = 0; i < num_symbols; i++){
+        if(decode_symbol(br, table, &out[i]) == 0)
+            return 0;
     }
     return 1;
-}
\ No newline at end of file
+}
+
+/// Decode NUM_STREAMS interleaved code streams into a buffer. The streams
+/// are decoded in the same loop so their bit reads don't wait on each other.
+/// @param br Array of NUM_STREAMS bit readers, one per stream
+/// @param num_bits Array of the number of code bits in each stream
+/// @param num_symbols Number of symbols in all streams together
+/// @param table Decode table shared by every stream
+/// @param out Buffer of at least num_symbols bytes
+/// @return 1 on success, 0 on a missing code or a stream of the wrong length
+int decode_interleaved( Bit_reader * br, const uint64_t * num_bits, size_t num_symbols, Decode_table table, uchar * out ){
+    // Work on local copies so stores to out can't alias the readers' state
+    Bit_reader br0 = br[0], br1 = br[1], br2 = br[2], br3 = br[3];
+    uint64_t used0 = 0, used1 = 0, used2 = 0, used3 = 0;
+    size_t i = 0;
+    int ok = 1;
+    for(; ok && i + NUM_STREAMS <= num_symbols; i += NUM_STREAMS){
+        uchar sym0, sym1, sym2, sym3;
+        uint bits0 = decode_symbol(&br0, table, &sym0);
+        uint bits1 = decode_symbol(&br1, table, &sym1);
+        uint bits2 = decode_symbol(&br2, table, &sym2);
+        uint bits3 = decode_symbol(&br3, table, &sym3);
+        out[i] = sym0;
+        out[i + 1] = sym1;
+        out[i + 2] = sym2;
+        out[i + 3] = sym3;
+        ok = bits0 != 0 && bits1 != 0 && bits2 != 0 && bits3 != 0;
+        used0 += bits0;
+        used1 += bits1;
+        used2 += bits2;
+        used3 += bits3;
+    }
+    br[0] = br0;
+    br[1] = br1;
+    br[2] = br2;
+    br[3] = br3;
+    uint64_t used[NUM_STREAMS] = { used0, used1, used2, used3 };
+    for(; ok && i < num_symbols; i++){
+        uint bits = decode_symbol(&br[i % NUM_STREAMS], table, &out[i]);
+        ok = bits != 0;
+        used[i % NUM_STREAMS] += bits;
+    }
+    for(int stream = 0; ok && stream < NUM_STREAMS; stream++)
+        ok = used[stream] == num_bits[stream];
+    return ok;
+}
@@ -7,19 +7,89 @@
 
 #ifndef DECODE_H
 #define DECODE_H
+#include <stdio.h>
 #include "packman_utils.h"
+#include "bitio.h"
+#include "canonical.h"
+#include "output.h"
 
-/// Get each bit from an unsigned integer array to be put in a string array
-/// @param num_bits Number of bits in encoded_binary
-/// @param encoded_binary Array of unsigned integers
-/// @return Array of strings each holding a bit from encoded_binary
-char ** uint_to_str_bits( uint num_bits, uint * encoded_binary );
-
-/// Decode and write each bit from a string array
-/// @param bits String array holding binary sequence to be decoded
-/// @param num_bits Number of bits in bit array
-/// @param lut Look up table
-/// @param fp Output stream to write to
-/// @return Method success or realloc failure
-int write_bits( char ** bits, uint num_bits, char ** lut, FILE * fp );
-#endif
\ No newline at end of file
+/// Number of code bits resolved by a lookup in the root decode table
+#define DECODE_ROOT_BITS  11
+
+/// Largest number of code bits resolved by a lookup in a sub table
+#define DECODE_SUB_BITS   7
+
+/// Decode table entry kinds
+enum { DECODE_INVALID = 0, DECODE_SYMBOL, DECODE_SUBTABLE };
+
+/// Decode_entry resolves the bits peeked at one level of the decode table.
+/// A symbol entry holds the symbol and the number of bits its code uses
+/// at this level. A sub table entry holds the offset of the next level
+/// and the number of bits that level is indexed by.
+typedef struct Decode_entry_s {
+    ushort value;   ///< symbol, or offset of the sub table
+    uchar bits;     ///< code bits consumed, or width of the sub table
+    uchar kind;     ///< DECODE_INVALID, DECODE_SYMBOL or DECODE_SUBTABLE
+} Decode_entry;
+
+/// Decode_table_s holds the root table followed by all of its sub tables.
+struct Decode_table_s {
+    Decode_entry * entries;  ///< root table at offset 0, then sub tables
+    uint size;               ///< number of entries in use
+    uint capacity;           ///< number of entries allocated
+    uchar root_bits;         ///< width of the root table
+};
+
+/// Decode_table is a pointer to a Decode_table structure.
+typedef struct Decode_table_s * Decode_table;
+
+/// Build a multi level decode table from the codes of a huffman tree
+/// @param tree Head of the huffman tree
+/// @return Decode table, or NULL if the tree is empty or too deep
+Decode_table create_decode_table( const Tree_node tree );
+
+/// Build a multi level decode table from the codes of a code book
+/// @param book Code book with codes assigned
+/// @return Decode table, or NULL if the code book is empty
+Decode_table create_book_decode_table( const Code_book * book );
+
+/// Free a decode table
+/// @param table Decode table to free
+void free_decode_table( Decode_table table );
+
+/// Decode code bits from a bit reader straight into an output's buffer
+/// @param br Bit reader positioned at the first code bit
+/// @param num_bits Number of code bits to decode
+/// @param table Decode table built from the huffman tree or code book
+/// @param out Output to write to
+/// @return Number of symbols decoded, 0 on a code missing from the table or a write failure
+uint64_t decode_stream( Bit_reader * br, uint64_t num_bits, Decode_table table, Output * out );
+
+/// Decode symbols each coded with the decode table of the symbol before
+/// it, straight into an output's buffer. The first symbol follows symbol 0.
+/// @param br Bit reader positioned at the first code bit
+/// @param num_symbols Number of symbols to decode
+/// @param num_bits Number of code bits the symbols use
+/// @param tables Decode table of each of the 256 previous symbols
+/// @param out Output to write to
+/// @return 1 on success, 0 on a missing code, a stream of the wrong length or a write failure
+int decode_context_stream( Bit_reader * br, uint64_t num_symbols, uint64_t num_bits, const Decode_table * tables, Output * out );
+
+/// Decode a known number of symbols from a bit reader into a buffer
+/// @param br Bit reader positioned at the first code bit
+/// @param num_symbols Number of symbols to decode
+/// @param table Decode table for the code stream
+/// @param out Buffer of at least num_symbols bytes
+/// @return 1 on success, 0 on a code missing from the table
+int decode_symbols( Bit_reader * br, size_t num_symbols, Decode_table table, uchar * out );
+
+/// Decode NUM_STREAMS interleaved code streams into a buffer. The streams
+/// are decoded in the same loop so their bit reads don't wait on each other.
+/// @param br Array of NUM_STREAMS bit readers, one per stream
+/// @param num_bits Array of the number of code bits in each stream
+/// @param num_symbols Number of symbols in all streams together
+/// @param table Decode table shared by every stream
+/// @param out Buffer of at least num_symbols bytes
+/// @return 1 on success, 0 on a missing code or a stream of the wrong length
+int decode_interleaved( Bit_reader * br, const uint64_t * num_bits, size_t num_symbols, Decode_table table, uchar * out );
+#endif
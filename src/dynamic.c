@@ -0,0 +1,205 @@
+//
+// file: dynamic.c
+// description: Implementation file for files coded with a model both sides adapt in lockstep
+//
+// @author Daniel Tregea
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "dynamic.h"
+#include "bitio.h"
+#include "canonical.h"
+#include "decode.h"
+#include "encode.h"
+#include "histogram.h"
+#include "stats.h"
+#include "utilities.h"
+
+/// Number of packed words that hold the codes of the largest segment
+#define SEGMENT_WORDS  ( (size_t) DYNAMIC_SEGMENT * MAX_CODE_LENGTH / BITS_IN_INT + 1 )
+
+/// Add a newly built code book to the statistics
+/// @param stats Statistics to add to, or NULL
+/// @param book Code book built
+static void add_model_stats( Packman_stats * stats, const Code_book * book ){
+    if(stats == NULL)
+        return;
+    stats->num_books++;
+    for(int i = 0; i < 256; i++)
+        if(book->length[i] > stats->longest_code)
+            stats->longest_code = book->length[i];
+}
+
+/// Start a model with a count of one for every symbol
+/// @param model Model to initialize
+/// @param max_length Longest code length allowed, 0 for no limit
+/// @return 1 on success, 0 if no code book fits the code length limit
+static int model_init( Dynamic_model * model, uint max_length ){
+    for(int i = 0; i < 256; i++)
+        model->counts[i] = 1;
+    model->total = 256;
+    model->max_length = max_length;
+    return build_code_book(model->counts, max_length, &model->book);
+}
+
+/// Add the counts of a segment to a model and rebuild its code book.
+/// Once the total passes DYNAMIC_MAX_TOTAL every count is halved,
+/// rounding up so that no symbol loses its code.
+/// @param model Model to update
+/// @param frequencies Symbol counts of the segment just coded
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 if no code book fits the code length limit
+static int model_update( Dynamic_model * model, const uint64_t * frequencies, Packman_stats * stats ){
+    double start = stats_start(stats);
+    for(int i = 0; i < 256; i++){
+        model->counts[i] += frequencies[i];
+        model->total += frequencies[i];
+    }
+    if(model->total > DYNAMIC_MAX_TOTAL){
+        model->total = 0;
+        for(int i = 0; i < 256; i++)
+            model->total += model->counts[i] = (model->counts[i] + 1) / 2;
+    }
+    if(!build_code_book(model->counts, model->max_length, &model->book))
+        return 0;
+    add_model_stats(stats, &model->book);
+    stats_stop(stats, PACKMAN_PHASE_BUILD, start);
+    return 1;
+}
+
+/// Write a coded segment: symbol count, bit count and code bits
+/// @param out Output stream to write to
+/// @param bw Buffer bit writer holding the codes of the segment
+/// @param num_symbols Number of symbols in the segment
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 on write failure
+static int write_segment( FILE * out, Bit_writer * bw, size_t num_symbols, Packman_stats * stats ){
+    uint count[1] = { (uint) num_symbols };
+    uint64_t num_bits[1] = { bw->total_bits };
+    if(!bw_flush(bw) || fwrite(count, sizeof(uint), 1, out) != 1
+       || fwrite(num_bits, sizeof(uint64_t), 1, out) != 1
+       || fwrite(bw->words, sizeof(uint), bw->num_words, out) != bw->num_words)
+        return 0;
+    if(stats != NULL){
+        stats->num_blocks++;
+        stats->num_symbols += num_symbols;
+        stats->code_bits += num_bits[0];
+    }
+    return 1;
+}
+
+/// Encode an input stream in a single pass with an adaptive code book.
+/// The input is coded in segments, each with the code book built from the
+/// segments before it, so coding starts without looking ahead and no code
+/// book is written.
+/// @param input Input to encode
+/// @param out Output stream to write the FORMAT_DYNAMIC file to
+/// @param max_length Longest code length allowed, 0 for no limit
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 on a read, write or allocation failure
+int encode_dynamic( Input * input, FILE * out, uint max_length, Packman_stats * stats ){
+    Dynamic_model model;
+    uchar length[1] = { (uchar) max_length };
+    uint * words = malloc(SEGMENT_WORDS * sizeof(uint));
+    if(words == NULL || !model_init(&model, max_length) || !write_container_header(out, FORMAT_DYNAMIC)
+       || fwrite(length, sizeof(uchar), 1, out) != 1){
+        free(words);
+        return 0;
+    }
+    add_model_stats(stats, &model.book);
+
+    // Each segment is packed into words, then written behind its bit count
+    Bit_writer bw;
+    bw_init_buffer(&bw, words, SEGMENT_WORDS);
+    uint64_t frequencies[256] = { 0 };
+    size_t segment = DYNAMIC_FIRST_SEGMENT, in_segment = 0, num_read;
+    const uchar * data;
+    int ok = 1;
+    while(ok && (num_read = input_next(input, segment - in_segment, &data)) > 0){
+        double start = stats_start(stats);
+        encode_buffer(data, num_read, &model.book, &bw);
+        count_frequencies(data, num_read, frequencies);
+        stats_stop(stats, PACKMAN_PHASE_ENCODE, start);
+        in_segment += num_read;
+        if(in_segment == segment){
+            ok = write_segment(out, &bw, in_segment, stats) && model_update(&model, frequencies, stats);
+            memset(frequencies, 0, sizeof(frequencies));
+            bw_init_buffer(&bw, words, SEGMENT_WORDS);
+            in_segment = 0;
+            if(segment < DYNAMIC_SEGMENT)
+                segment *= 2;
+        }
+    }
+    if(ok && in_segment > 0)
+        ok = write_segment(out, &bw, in_segment, stats);
+
+    // A segment of no symbols ends the file
+    uint end[1] = { 0 };
+    ok = ok && !input_error(input) && fwrite(end, sizeof(uint), 1, out) == 1;
+    free(words);
+    return ok;
+}
+
+/// Decode the segments of a FORMAT_DYNAMIC file, rebuilding the code book
+/// after each segment as the encoder did
+/// @param in Input stream positioned after the format byte
+/// @param out Output to write the decoded symbols to
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 on a malformed segment, allocation or write failure
+int decode_dynamic( FILE * in, Output * out, Packman_stats * stats ){
+    uchar length[1];
+    Dynamic_model model;
+    if(fread(length, sizeof(uchar), 1, in) != 1 || length[0] > MAX_CODE_LENGTH || !model_init(&model, length[0]))
+        return 0;
+    add_model_stats(stats, &model.book);
+    Decode_table table = create_book_decode_table(&model.book);
+    uint * words = malloc(SEGMENT_WORDS * sizeof(uint));
+    uchar * symbols = malloc(DYNAMIC_SEGMENT);
+    int ok = table != NULL && words != NULL && symbols != NULL;
+
+    uint num_symbols[1];
+    uint64_t num_bits[1];
+    while(ok && (ok = fread(num_symbols, sizeof(uint), 1, in) == 1) && num_symbols[0] > 0){
+        double start = stats_start(stats);
+        size_t num_words = 0;
+        ok = num_symbols[0] <= DYNAMIC_SEGMENT && fread(num_bits, sizeof(uint64_t), 1, in) == 1
+          && (num_words = bits_to_num_uint(num_bits[0])) <= SEGMENT_WORDS
+          && fread(words, sizeof(uint), num_words, in) == num_words;
+
+        // Segments are decoded straight into the output's buffer when it has room
+        uchar * reserved = NULL;
+        int in_place = ok && output_reserve(out, num_symbols[0], &reserved) >= num_symbols[0];
+        uchar * decoded = in_place ? reserved : symbols;
+        if(ok){
+            Bit_reader br;
+            br_init(&br, words, num_words);
+            ok = decode_symbols(&br, num_symbols[0], table, decoded) && br_bits_used(&br) == num_bits[0];
+        }
+        stats_stop(stats, PACKMAN_PHASE_DECODE, start);
+        if(!ok)
+            break;
+        if(stats != NULL){
+            stats->num_blocks++;
+            stats->num_symbols += num_symbols[0];
+            stats->code_bits += num_bits[0];
+        }
+
+        // Follow the encoder: count the segment, then code the next one with the rebuilt book
+        uint64_t frequencies[256] = { 0 };
+        count_frequencies(decoded, num_symbols[0], frequencies);
+        if(in_place)
+            output_commit(out, num_symbols[0]);
+        else
+            ok = output_write(out, symbols, num_symbols[0]);
+        free_decode_table(table);
+        ok = ok && model_update(&model, frequencies, stats) && (table = create_book_decode_table(&model.book)) != NULL;
+        if(!ok)
+            table = NULL;
+    }
+    if(table != NULL)
+        free_decode_table(table);
+    free(words);
+    free(symbols);
+    return ok;
+}
@@ -0,0 +1,63 @@
+//
+// file: dynamic.h
+// description: Definition file for files coded with a model both sides adapt in lockstep
+//
+// @author Daniel Tregea
+//
+
+#ifndef DYNAMIC_H
+#define DYNAMIC_H
+#include <stdio.h>
+#include "packman_utils.h"
+#include "canonical.h"
+#include "input.h"
+#include "libpackman.h"
+#include "output.h"
+
+/// Number of symbols in the first segment of a FORMAT_DYNAMIC file
+#define DYNAMIC_FIRST_SEGMENT  ( 1 << 10 )
+
+/// Largest number of symbols in a segment. Segments double in size from
+/// DYNAMIC_FIRST_SEGMENT, so the model learns quickly at the start.
+#define DYNAMIC_SEGMENT  ( 1 << 16 )
+
+/// Total count above which the model's counts are halved, so the code
+/// book follows the recent input rather than the whole stream
+#define DYNAMIC_MAX_TOTAL  ( 1 << 22 )
+
+/// Shortest code length limit a FORMAT_DYNAMIC file allows, since all
+/// 256 symbols have a code
+#define DYNAMIC_MIN_LENGTH  8
+
+/// Dynamic_model holds the running symbol counts that the encoder and the
+/// decoder of a FORMAT_DYNAMIC file both keep. Every symbol starts with a
+/// count of one, so every symbol always has a code. After each segment the
+/// segment's counts are added and the code book is rebuilt from the totals,
+/// the same way on both sides, so no code book is stored in the file.
+typedef struct Dynamic_model_s {
+    uint64_t counts[256];  ///< running count of each symbol
+    uint64_t total;        ///< sum of counts
+    uint max_length;       ///< longest code length allowed, 0 for no limit
+    Code_book book;        ///< code book built from counts
+} Dynamic_model;
+
+/// Encode an input stream in a single pass with an adaptive code book.
+/// The input is coded in segments, each with the code book built from the
+/// segments before it, so coding starts without looking ahead and no code
+/// book is written.
+/// @param input Input to encode
+/// @param out Output stream to write the FORMAT_DYNAMIC file to
+/// @param max_length Longest code length allowed, 0 for no limit
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 on a read, write or allocation failure
+int encode_dynamic( Input * input, FILE * out, uint max_length, Packman_stats * stats );
+
+/// Decode the segments of a FORMAT_DYNAMIC file, rebuilding the code book
+/// after each segment as the encoder did
+/// @param in Input stream positioned after the format byte
+/// @param out Output to write the decoded symbols to
+/// @param stats Timings and counters to add to, or NULL
+/// @return 1 on success, 0 on a malformed segment, allocation or write failure
+int decode_dynamic( FILE * in, Output * out, Packman_stats * stats );
+
+#endif
@@ -6,53 +6,334 @@
 //
 
 #include <stdlib.h>
+#include <string.h>
 #include "packman_utils.h"
 #include "encode.h"
+#include "histogram.h"
 #include "utilities.h"
 
-/// Comparison function for min heaps
-/// @param first_node Node to be compared to second_node
-/// @param second_node Node to be compared to first_node
-/// @return Whether first_node is less than second_node
-int compare_node_min( const void * first_node, const void * second_node ){
-    Tree_node left = (Tree_node)first_node;
-    Tree_node right = (Tree_node)second_node;
-    return left->freq < right->freq;
-}
-
-/// Print function for frequency heap nodes
-/// @param item Frequency heap node to print
-/// @param outfp Stream to print node to
-void print_node( const void * item, FILE * outfp ){
-    Tree_node node = (Tree_node) item;
-    fprintf(outfp, "Frequency: %d, Symbol: %u\n", node->freq, node->sym);
-}
-
-/// Generate a huffman tree from a frequency heap
-/// @param heap Frequency heap
-/// @return Head of newly created huffman tree
-Tree_node heap_to_huffman( Heap heap ){
-    while(hdt_size(heap) >= 2){
-        Tree_node n1 = hdt_remove_top(heap);
-        Tree_node n2 = hdt_remove_top(heap);
-        Tree_node nx = create_tree_node(0, (n1->freq + n2->freq), 1);
-        nx->left = n1;
-        nx->right = n2;
-        hdt_insert_item(heap, nx);
-    }
-    return (Tree_node) hdt_top(heap);
-}
-
-/// Compress a sequence of 1's and 0's into an array of unsigned integers
-/// @param bits Array of encoded binary
-/// @param num_bits size of "bits"
-/// @param num_uint Number of unsigned integers (4 bytes) needed to hold all bits in "bits" array
-/// @return Array of unsigned integers holding binary sequence from "bits" array
-uint * pack_bits( const uint * bits, uint num_bits, uint num_uint ){
-    uint * encoded_binary = calloc(num_uint, sizeof(uint));
-    for(uint i = 0; i < num_bits; i++){
-        if(bits[i] == 1) // insert a 1 in the correct position within an unsigned integer
-            encoded_binary[get_byte_index(i)] |= get_mask(i);
-    }
-    return encoded_binary;
-}
\ No newline at end of file
+/// Merge_item is a coin in one level of package-merge: a leaf of the
+/// alphabet, or a package of two items from the level below.
+typedef struct Merge_item_s {
+    uint64_t weight;  ///< leaf frequency, or sum of the packaged items
+    int sym;          ///< symbol of a leaf, -1 for a package
+    int first;        ///< index of the first packaged item in the level below
+} Merge_item;
+
+/// Add one to the code length of every leaf inside a package-merge item
+/// @param levels Item lists of every level, deepest level first
+/// @param level Level the item belongs to
+/// @param index Index of the item within its level
+/// @param lengths Array of 256 code lengths to update
+static void count_leaves( Merge_item ** levels, uint level, int index, uchar * lengths ){
+    const Merge_item * item = &levels[level][index];
+    if(item->sym >= 0){
+        lengths[item->sym]++;
+        return;
+    }
+    count_leaves(levels, level - 1, item->first, lengths);
+    count_leaves(levels, level - 1, item->first + 1, lengths);
+}
+
+/// Ordering function for sorting leaves by ascending frequency
+/// @param lhs Leaf to be compared to rhs
+/// @param rhs Leaf to be compared to lhs
+/// @return Negative, zero or positive as lhs sorts before, with or after rhs
+static int compare_leaf_weight( const void * lhs, const void * rhs ){
+    const Merge_item * left = lhs, * right = rhs;
+    if(left->weight != right->weight)
+        return left->weight < right->weight ? -1 : 1;
+    return left->sym - right->sym;
+}
+
+/// Compute optimal code lengths no longer than max_length with package-merge
+/// @param frequencies Number of occurrences of each of the 256 symbols
+/// @param max_length Longest code length allowed
+/// @param lengths Array of 256 code lengths to fill
+/// @return 1 on success, 0 if max_length is too short for the number of symbols
+static int package_merge( const uint64_t * frequencies, uint max_length, uchar * lengths ){
+    Merge_item leaves[256];
+    int num_leaves = 0;
+    for(int i = 0; i < 256; i++){
+        if(frequencies[i] > 0){
+            Merge_item leaf = { frequencies[i], i, 0 };
+            leaves[num_leaves++] = leaf;
+        }
+    }
+    memset(lengths, 0, 256 * sizeof(uchar));
+    if(max_length < 64 && (UINT64_C(1) << max_length) < (uint64_t) num_leaves)
+        return 0;
+    qsort(leaves, num_leaves, sizeof(Merge_item), compare_leaf_weight);
+
+    // Level 0 is the deepest level and holds only the leaves. Every level
+    // above merges the leaves with the pairs packaged from the level below.
+    Merge_item ** levels = malloc(max_length * sizeof(Merge_item *));
+    int * level_size = malloc(max_length * sizeof(int));
+    Merge_item * storage = malloc((size_t) max_length * 2 * num_leaves * sizeof(Merge_item));
+    if(levels == NULL || level_size == NULL || storage == NULL){
+        free(levels);
+        free(level_size);
+        free(storage);
+        return 0;
+    }
+    for(uint level = 0; level < max_length; level++){
+        levels[level] = storage + (size_t) level * 2 * num_leaves;
+        if(level == 0){
+            memcpy(levels[0], leaves, num_leaves * sizeof(Merge_item));
+            level_size[0] = num_leaves;
+            continue;
+        }
+        int num_packages = level_size[level - 1] / 2, leaf = 0, package = 0, size = 0;
+        while(leaf < num_leaves || package < num_packages){
+            uint64_t package_weight = package < num_packages
+                ? levels[level - 1][2 * package].weight + levels[level - 1][2 * package + 1].weight : 0;
+            if(package == num_packages || (leaf < num_leaves && leaves[leaf].weight <= package_weight)){
+                levels[level][size++] = leaves[leaf++];
+            } else {
+                Merge_item item = { package_weight, -1, 2 * package };
+                levels[level][size++] = item;
+                package++;
+            }
+        }
+        level_size[level] = size;
+    }
+
+    // The cheapest 2n - 2 items of the top level hold every leaf once per code bit
+    for(int i = 0; i < 2 * num_leaves - 2; i++)
+        count_leaves(levels, max_length - 1, i, lengths);
+
+    free(levels);
+    free(level_size);
+    free(storage);
+    return 1;
+}
+
+/// Huffman_leaf is a symbol waiting to be merged into a huffman tree
+typedef struct Huffman_leaf_s {
+    uint64_t freq;  ///< number of occurrences of the symbol
+    uint sym;       ///< the symbol
+} Huffman_leaf;
+
+/// Check whether a leaf sorts before another, by frequency then symbol
+/// @param lhs Leaf to be compared to rhs
+/// @param rhs Leaf to be compared to lhs
+/// @return Whether lhs sorts before rhs
+static inline int leaf_before( const Huffman_leaf * lhs, const Huffman_leaf * rhs ){
+    return lhs->freq < rhs->freq || (lhs->freq == rhs->freq && lhs->sym < rhs->sym);
+}
+
+/// Sort leaves by ascending frequency with a shell sort, which needs no
+/// comparison callback and is quick for at most 256 leaves
+/// @param leaves Leaves to sort
+/// @param num_leaves Number of leaves
+static void sort_leaves( Huffman_leaf * leaves, int num_leaves ){
+    static const int gaps[] = { 132, 57, 23, 10, 4, 1 };
+    for(size_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++){
+        int gap = gaps[g];
+        for(int i = gap; i < num_leaves; i++){
+            Huffman_leaf leaf = leaves[i];
+            int j = i;
+            for(; j >= gap && leaf_before(&leaf, &leaves[j - gap]); j -= gap)
+                leaves[j] = leaves[j - gap];
+            leaves[j] = leaf;
+        }
+    }
+}
+
+/// Compute huffman code lengths with the two-queue method.
+/// The leaves are sorted once, and interior nodes come out of the merges
+/// in ascending weight, so the two lightest nodes are always at the head
+/// of one of the two arrays. Nodes are array indices, not pointers.
+/// @param frequencies Number of occurrences of each of the 256 symbols
+/// @param lengths Array of 256 code lengths to fill
+/// @return 1 on success, 0 if there are no symbols or a code is longer than MAX_CODE_LENGTH
+int huffman_code_lengths( const uint64_t * frequencies, uchar * lengths ){
+    Huffman_leaf leaves[256];
+    int num_leaves = 0;
+    for(int i = 0; i < 256; i++){
+        if(frequencies[i] > 0){
+            Huffman_leaf leaf = { frequencies[i], i };
+            leaves[num_leaves++] = leaf;
+        }
+    }
+    memset(lengths, 0, 256 * sizeof(uchar));
+    if(num_leaves == 0)
+        return 0;
+    if(num_leaves == 1){ // a lone symbol still needs one bit
+        lengths[leaves[0].sym] = 1;
+        return 1;
+    }
+    sort_leaves(leaves, num_leaves);
+
+    // Leaves are nodes 0 .. n - 1 and interior nodes n .. 2n - 2, in the
+    // order they are made. Ties go to the leaf, which keeps codes short.
+    uint64_t weight[256];
+    ushort parent[MAX_TREE_NODES];
+    int leaf = 0, head = 0;
+    for(int made = 0; made < num_leaves - 1; made++){
+        uint64_t sum = 0;
+        for(int pick = 0; pick < 2; pick++){
+            int node;
+            if(leaf < num_leaves && (head == made || leaves[leaf].freq <= weight[head])){
+                sum += leaves[leaf].freq;
+                node = leaf++;
+            } else {
+                sum += weight[head];
+                node = num_leaves + head++;
+            }
+            parent[node] = num_leaves + made;
+        }
+        weight[made] = sum;
+    }
+
+    // Every node is made before its parent, so depths fill in from the root down
+    uchar depth[MAX_TREE_NODES];
+    int root = 2 * num_leaves - 2;
+    depth[root] = 0;
+    for(int node = root - 1; node >= 0; node--)
+        depth[node] = depth[parent[node]] + 1;
+    for(int i = 0; i < num_leaves; i++){
+        if(depth[i] > MAX_CODE_LENGTH)
+            return 0;
+        lengths[leaves[i].sym] = depth[i];
+    }
+    return 1;
+}
+
+/// Build a canonical code book from symbol frequencies
+/// @param frequencies Number of occurrences of each of the 256 symbols
+/// @param max_length Longest code length allowed, 0 for no limit
+/// @param book Code book to fill
+/// @return 1 on success, 0 if there are no symbols or the codes are too long
+int build_code_book( const uint64_t * frequencies, uint max_length, Code_book * book ){
+    size_t num_unique = 0;
+    for(int i = 0; i < 256; i++)
+        if(frequencies[i] > 0)
+            num_unique++;
+    if(num_unique == 0)
+        return 0;
+    int built = huffman_code_lengths(frequencies, book->length);
+
+    // Fall back to package-merge only when the huffman codes are too long
+    uint longest = 0;
+    for(int i = 0; i < 256; i++)
+        if(book->length[i] > longest)
+            longest = book->length[i];
+    if(max_length == 0)
+        max_length = MAX_CODE_LENGTH;
+    if((!built || longest > max_length) && num_unique > 1)
+        built = package_merge(frequencies, max_length, book->length);
+
+    return built && assign_canonical_codes(book);
+}
+
+/// Encode every symbol of a buffer and append the codes to a bit writer.
+/// When no code is longer than 8 or 16 bits, four or two codes are joined
+/// and appended together.
+/// @param data Symbols to encode
+/// @param len Number of symbols in data
+/// @param book Code book of symbol codes
+/// @param bw Bit writer the codes are appended to
+void encode_buffer( const uchar * data, size_t len, const Code_book * book, Bit_writer * bw ){
+    const uint64_t * code = book->code;
+    const uchar * length = book->length;
+    uint longest = 0;
+    for(int symbol = 0; symbol < 256; symbol++)
+        if(length[symbol] > longest)
+            longest = length[symbol];
+
+    // Join short codes so several symbols go into the writer at once
+    size_t i = 0;
+    if(longest <= BITS_IN_INT / 4){
+        for(; i + 4 <= len; i += 4){
+            uint64_t codes = (code[data[i]] << length[data[i + 1]]) | code[data[i + 1]];
+            codes = (codes << length[data[i + 2]]) | code[data[i + 2]];
+            codes = (codes << length[data[i + 3]]) | code[data[i + 3]];
+            bw_put_word_bits(bw, codes, length[data[i]] + length[data[i + 1]]
+                                        + length[data[i + 2]] + length[data[i + 3]]);
+        }
+    } else if(longest <= BITS_IN_INT / 2){
+        for(; i + 2 <= len; i += 2){
+            uint64_t codes = (code[data[i]] << length[data[i + 1]]) | code[data[i + 1]];
+            bw_put_word_bits(bw, codes, length[data[i]] + length[data[i + 1]]);
+        }
+    }
+    for(; i < len; i++)
+        bw_put_bits(bw, code[data[i]], length[data[i]]);
+}
+
+/// Encode every symbol of a buffer with the code book of the symbol
+/// before it and append the codes to a bit writer
+/// @param data Symbols to encode
+/// @param len Number of symbols in data
+/// @param books Code book of each of the 256 previous symbols
+/// @param previous Symbol before data, set to the last symbol of data
+/// @param bw Bit writer the codes are appended to
+void encode_context_buffer( const uchar * data, size_t len, const Code_book * const * books, uchar * previous, Bit_writer * bw ){
+    uchar prev = *previous;
+    for(size_t i = 0; i < len; i++){
+        const Code_book * book = books[prev];
+        bw_put_bits(bw, book->code[data[i]], book->length[data[i]]);
+        prev = data[i];
+    }
+    *previous = prev;
+}
+
+/// Count the code bits each of NUM_STREAMS interleaved streams needs
+/// @param data Symbols to encode
+/// @param len Number of symbols in data
+/// @param book Code book of symbol codes
+/// @param stream_bits Set to the number of code bits of each stream
+void count_stream_bits( const uchar * data, size_t len, const Code_book * book, uint64_t * stream_bits ){
+    for(int stream = 0; stream < NUM_STREAMS; stream++)
+        stream_bits[stream] = 0;
+    for(size_t i = 0; i < len; i++)
+        stream_bits[i % NUM_STREAMS] += book->length[data[i]];
+}
+
+/// Encode a buffer as NUM_STREAMS interleaved code streams, symbol i
+/// going to stream i % NUM_STREAMS
+/// @param data Symbols to encode
+/// @param len Number of symbols in data
+/// @param book Code book shared by every stream
+/// @param bw Array of NUM_STREAMS bit writers, one per stream
+void encode_interleaved( const uchar * data, size_t len, const Code_book * book, Bit_writer * bw ){
+    size_t i = 0;
+    for(; i + NUM_STREAMS <= len; i += NUM_STREAMS){
+        bw_put_bits(&bw[0], book->code[data[i]], book->length[data[i]]);
+        bw_put_bits(&bw[1], book->code[data[i + 1]], book->length[data[i + 1]]);
+        bw_put_bits(&bw[2], book->code[data[i + 2]], book->length[data[i + 2]]);
+        bw_put_bits(&bw[3], book->code[data[i + 3]], book->length[data[i + 3]]);
+    }
+    for(; i < len; i++)
+        bw_put_bits(&bw[i % NUM_STREAMS], book->code[data[i]], book->length[data[i]]);
+}
+
+/// Count the occurrences of each symbol from the current position to the end of an input
+/// @param input Input to count
+/// @param frequencies Array of 256 counts to add to
+/// @return 1 on success, 0 on a read failure
+int count_input( Input * input, uint64_t * frequencies ){
+    const uchar * data;
+    size_t len;
+    while((len = input_next(input, SIZE_MAX, &data)) > 0)
+        count_frequencies(data, len, frequencies);
+    return !input_error(input);
+}
+
+/// Encode every symbol from the current position to the end of an input
+/// and append the codes to a bit writer
+/// @param input Input to encode
+/// @param book Code book of symbol codes
+/// @param bw Bit writer the codes are appended to
+/// @return 1 on success, 0 on a read or write failure
+int encode_input( Input * input, const Code_book * book, Bit_writer * bw ){
+    const uchar * data;
+    size_t len;
+    while((len = input_next(input, INPUT_BUFSIZE, &data)) > 0){
+        encode_buffer(data, len, book, bw);
+        if(bw->error)
+            return 0;
+    }
+    return !input_error(input);
+}
@@ -8,30 +8,75 @@
 #ifndef ENCODE_H
 #define ENCODE_H
 #include <stdio.h>
-#include "HeapDT.h"
 #include "packman_utils.h"
+#include "bitio.h"
+#include "canonical.h"
+#include "input.h"
 
-/// Comparison function for min heaps
-/// @param first_node Node to be compared to second_node
-/// @param second_node Node to be compared to first_node
-/// @return Whether first_node is less than second_node
-int compare_node_min( const void * first_node, const void * second_node );
-
-/// Print function for frequency heap nodes
-/// @param item Frequency heap node to print
-/// @param outfp Stream to print node to
-void print_node( const void * item, FILE * outfp );
-
-/// Generate a huffman tree from a frequency heap
-/// @param heap Frequency heap
-/// @return Head of newly created huffman tree
-Tree_node heap_to_huffman( Heap heap );
-
-/// Compress a sequence of 1's and 0's into an array of unsigned integers
-/// @param bits Array of encoded binary
-/// @param num_bits size of "bits"
-/// @param num_uint Number of unsigned integers (4 bytes) needed to hold all bits in "bits" array
-/// @return Array of unsigned integers holding each bit from the "bits" array
-uint * pack_bits( const uint * bits, uint num_bits, uint num_uint );
+/// Compute huffman code lengths with the two-queue method.
+/// The leaves are sorted once, and interior nodes come out of the merges
+/// in ascending weight, so the two lightest nodes are always at the head
+/// of one of the two arrays. Nodes are array indices, not pointers.
+/// @param frequencies Number of occurrences of each of the 256 symbols
+/// @param lengths Array of 256 code lengths to fill
+/// @return 1 on success, 0 if there are no symbols or a code is longer than MAX_CODE_LENGTH
+int huffman_code_lengths( const uint64_t * frequencies, uchar * lengths );
+
+/// Build a canonical code book from symbol frequencies.
+/// Huffman codes longer than max_length are replaced by the optimal
+/// length limited codes found by package-merge, which keeps decode
+/// tables small and bounds the cost of decoding any one symbol.
+/// @param frequencies Number of occurrences of each of the 256 symbols
+/// @param max_length Longest code length allowed, 0 for no limit
+/// @param book Code book to fill
+/// @return 1 on success, 0 if there are no symbols or the codes are too long
+int build_code_book( const uint64_t * frequencies, uint max_length, Code_book * book );
+
+/// Encode every symbol of a buffer and append the codes to a bit writer.
+/// When no code is longer than 8 or 16 bits, four or two codes are joined
+/// and appended together.
+/// @param data Symbols to encode
+/// @param len Number of symbols in data
+/// @param book Code book of symbol codes
+/// @param bw Bit writer the codes are appended to
+void encode_buffer( const uchar * data, size_t len, const Code_book * book, Bit_writer * bw );
+
+/// Encode every symbol of a buffer with the code book of the symbol
+/// before it and append the codes to a bit writer
+/// @param data Symbols to encode
+/// @param len Number of symbols in data
+/// @param books Code book of each of the 256 previous symbols
+/// @param previous Symbol before data, set to the last symbol of data
+/// @param bw Bit writer the codes are appended to
+void encode_context_buffer( const uchar * data, size_t len, const Code_book * const * books, uchar * previous, Bit_writer * bw );
+
+/// Count the code bits each of NUM_STREAMS interleaved streams needs
+/// @param data Symbols to encode
+/// @param len Number of symbols in data
+/// @param book Code book of symbol codes
+/// @param stream_bits Set to the number of code bits of each stream
+void count_stream_bits( const uchar * data, size_t len, const Code_book * book, uint64_t * stream_bits );
+
+/// Encode a buffer as NUM_STREAMS interleaved code streams, symbol i
+/// going to stream i % NUM_STREAMS
+/// @param data Symbols to encode
+/// @param len Number of symbols in data
+/// @param book Code book shared by every stream
+/// @param bw Array of NUM_STREAMS bit writers, one per stream
+void encode_interleaved( const uchar * data, size_t len, const Code_book * book, Bit_writer * bw );
+
+/// Count the occurrences of each symbol from the current position to the end of an input
+/// @param input Input to count
+/// @param frequencies Array of 256 counts to add to
+/// @return 1 on success, 0 on a read failure
+int count_input( Input * input, uint64_t * frequencies );
+
+/// Encode every symbol from the current position to the end of an input
+/// and append the codes to a bit writer
+/// @param input Input to encode
+/// @param book Code book of symbol codes
+/// @param bw Bit writer the codes are appended to
+/// @return 1 on success, 0 on a read or write failure
+int encode_input( Input * input, const Code_book * book, Bit_writer * bw );
 
 #endif
\ No newline at end of file
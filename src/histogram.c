@@ -0,0 +1,114 @@
+//
+// file: histogram.c
+// description: Implementation file for counting symbol frequencies
+//
+// @author Daniel Tregea
+//
+
+#include <string.h>
+#include "histogram.h"
+
+/// Largest number of bytes counted before the tables are summed, so no
+/// 32 bit table entry can overflow
+#define HISTOGRAM_CHUNK  ( (size_t) 1 << 30 )
+
+/// Count the eight bytes of a word, one byte per table
+/// @param word Eight bytes read from the buffer
+/// @param counts Count tables to add to
+static inline void count_word( uint64_t word, uint counts[][256] ){
+    counts[0][word & 0xFF]++;
+    counts[1][(word >> 8) & 0xFF]++;
+    counts[2][(word >> 16) & 0xFF]++;
+    counts[3][(word >> 24) & 0xFF]++;
+    counts[4][(word >> 32) & 0xFF]++;
+    counts[5][(word >> 40) & 0xFF]++;
+    counts[6][(word >> 48) & 0xFF]++;
+    counts[7][word >> 56]++;
+}
+
+/// Count a buffer eight bytes at a time with plain word loads
+/// @param data Symbols to count
+/// @param len Number of symbols in data
+/// @param counts Count tables to add to
+static void count_tables( const uchar * data, size_t len, uint counts[][256] ){
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16){
+        uint64_t words[2];
+        memcpy(words, data + i, sizeof(words));
+        count_word(words[0], counts);
+        count_word(words[1], counts);
+    }
+    for(; i < len; i++)
+        counts[i % HISTOGRAM_TABLES][data[i]]++;
+}
+
+/// Count the occurrences of each symbol in a buffer.
+/// Consecutive bytes are counted in different tables so runs of one symbol
+/// don't wait on each other's increments, and the tables are summed at the
+/// end.
+/// @param data Symbols to count
+/// @param len Number of symbols in data
+/// @param frequencies Array of 256 counts to add to
+void count_frequencies( const uchar * data, size_t len, uint64_t * frequencies ){
+    uint counts[HISTOGRAM_TABLES][256];
+    while(len > 0){
+        size_t chunk = len < HISTOGRAM_CHUNK ? len : HISTOGRAM_CHUNK;
+        memset(counts, 0, sizeof(counts));
+        count_tables(data, chunk, counts);
+        for(int symbol = 0; symbol < 256; symbol++){
+            uint64_t sum = 0;
+            for(int table = 0; table < HISTOGRAM_TABLES; table++)
+                sum += counts[table][symbol];
+            frequencies[symbol] += sum;
+        }
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+/// Count the occurrences of each symbol after each previous symbol
+/// @param data Symbols to count
+/// @param len Number of symbols in data
+/// @param previous Symbol before data, set to the last symbol of data
+/// @param frequencies 256 arrays of 256 counts to add to, indexed by previous symbol
+void count_context_frequencies( const uchar * data, size_t len, uchar * previous, uint64_t (*frequencies)[256] ){
+    uchar prev = *previous;
+    for(size_t i = 0; i < len; i++){
+        frequencies[prev][data[i]]++;
+        prev = data[i];
+    }
+    *previous = prev;
+}
+
+/// Approximate the base 2 logarithm of a count, to within about 0.0001
+/// @param x Count, at least 1
+/// @return log2 of x
+double log2_count( uint64_t x ){
+    // Split x into a power of two and a mantissa in [1, 2)
+    int exponent = 0;
+    for(int shift = 32; shift > 0; shift >>= 1){
+        if(x >> (exponent + shift))
+            exponent += shift;
+    }
+    double mantissa = (double) x / (double)((uint64_t) 1 << exponent);
+
+    // log2(m) = 2 / ln 2 * atanh((m - 1) / (m + 1)), with t below 1/3
+    double t = (mantissa - 1) / (mantissa + 1), t2 = t * t;
+    return exponent + 2.8853900817779268 * t * (1 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 / 7)));
+}
+
+/// Estimate the number of bits an ideal code needs for a set of symbol
+/// counts, the sum over symbols of count * log2(total / count)
+/// @param frequencies Array of 256 counts
+/// @return Estimated number of code bits
+double entropy_bits( const uint64_t * frequencies ){
+    uint64_t total = 0;
+    double sum = 0;
+    for(int symbol = 0; symbol < 256; symbol++){
+        if(frequencies[symbol] > 0){
+            total += frequencies[symbol];
+            sum += frequencies[symbol] * log2_count(frequencies[symbol]);
+        }
+    }
+    return total == 0 ? 0 : total * log2_count(total) - sum;
+}
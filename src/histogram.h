@@ -0,0 +1,43 @@
+//
+// file: histogram.h
+// description: Definition file for counting symbol frequencies
+//
+// @author Daniel Tregea
+//
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+#include <stddef.h>
+#include "packman_utils.h"
+
+/// Number of count tables the histogram spreads increments over
+#define HISTOGRAM_TABLES  8
+
+/// Count the occurrences of each symbol in a buffer.
+/// Consecutive bytes are counted in different tables so runs of one symbol
+/// don't wait on each other's increments, and the tables are summed at the
+/// end.
+/// @param data Symbols to count
+/// @param len Number of symbols in data
+/// @param frequencies Array of 256 counts to add to
+void count_frequencies( const uchar * data, size_t len, uint64_t * frequencies );
+
+/// Count the occurrences of each symbol after each previous symbol
+/// @param data Symbols to count
+/// @param len Number of symbols in data
+/// @param previous Symbol before data, set to the last symbol of data
+/// @param frequencies 256 arrays of 256 counts to add to, indexed by previous symbol
+void count_context_frequencies( const uchar * data, size_t len, uchar * previous, uint64_t (*frequencies)[256] );
+
+/// Approximate the base 2 logarithm of a count, to within about 0.0001
+/// @param x Count, at least 1
+/// @return log2 of x
+double log2_count( uint64_t x );
+
+/// Estimate the number of bits an ideal code needs for a set of symbol
+/// counts, the sum over symbols of count * log2(total / count)
+/// @param frequencies Array of 256 counts
+/// @return Estimated number of code bits
+double entropy_bits( const uint64_t * frequencies );
+
+#endif
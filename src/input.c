@@ -0,0 +1,155 @@
+//
+// file: input.c
+// description: Implementation file for reading input files through a memory mapping
+//
+// @author Daniel Tregea
+//
+
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "input.h"
+
+/// Open an input file, mapping it into memory when possible
+/// @param input Input to initialize
+/// @param name Name of the file to open, "-" for stdin
+/// @return 1 on success, 0 if the file can't be opened
+int input_open( Input * input, const char * name ){
+    memset(input, 0, sizeof(Input));
+    input->fp = strcmp(name, "-") == 0 ? stdin : fopen(name, "rb");
+    if(input->fp == NULL)
+        return 0;
+
+    struct stat st;
+    int fd = fileno(input->fp);
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode)){
+        input->seekable = 1;
+        if(st.st_size > 0){
+            void * map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(map != MAP_FAILED){
+                madvise(map, st.st_size, MADV_SEQUENTIAL);
+                input->map = map;
+                input->mapped = 1;
+                input->size = st.st_size;
+                return 1;
+            }
+        }
+    }
+
+    // Fall back to large buffered reads
+    input->buf = malloc(INPUT_BUFSIZE);
+    if(input->buf == NULL){
+        input_close(input);
+        return 0;
+    }
+    return 1;
+}
+
+/// Read a caller's buffer as input, without copying it
+/// @param input Input to initialize
+/// @param data Bytes to read, valid until the input is closed
+/// @param len Number of bytes in data
+void input_open_buffer( Input * input, const uchar * data, size_t len ){
+    memset(input, 0, sizeof(Input));
+    input->map = data;
+    input->size = len;
+    input->seekable = 1;
+}
+
+/// Look at the unread bytes at the current position without consuming them
+/// @param input Input to peek at
+/// @param data Set to the first unread byte
+/// @return Number of bytes available at data, 0 at the end of the input
+size_t input_peek( Input * input, const uchar ** data ){
+    if(input->map != NULL){
+        *data = input->map + input->pos;
+        return input->size - input->pos;
+    }
+    if(input->fp == NULL){ // an empty buffer
+        *data = NULL;
+        return 0;
+    }
+    if(input->pos == input->len){
+        input->len = fread(input->buf, sizeof(uchar), INPUT_BUFSIZE, input->fp);
+        input->pos = 0;
+    }
+    *data = input->buf + input->pos;
+    return input->len - input->pos;
+}
+
+/// Consume the next chunk of the input
+/// @param input Input to read from
+/// @param max Largest number of bytes to consume
+/// @param data Set to the first byte of the chunk
+/// @return Number of bytes in the chunk, 0 at the end of the input
+size_t input_next( Input * input, size_t max, const uchar ** data ){
+    size_t len = input_peek(input, data);
+    if(len > max)
+        len = max;
+    input->pos += len;
+    return len;
+}
+
+/// Copy the next bytes of the input into a buffer
+/// @param input Input to read from
+/// @param dst Buffer to copy into
+/// @param len Number of bytes wanted
+/// @return Number of bytes copied, less than len only at the end of the input
+size_t input_read( Input * input, uchar * dst, size_t len ){
+    size_t copied = 0, chunk;
+    const uchar * data;
+    while(copied < len && (chunk = input_next(input, len - copied, &data)) > 0){
+        memcpy(dst + copied, data, chunk);
+        copied += chunk;
+    }
+    return copied;
+}
+
+/// Check whether reading the input failed
+/// @param input Input to check
+/// @return nonzero if a read failed
+int input_error( Input * input ){
+    return input->fp != NULL && ferror(input->fp);
+}
+
+/// Go back to the start of the input for another pass
+/// @param input Input to rewind
+/// @return 1 on success, 0 if the input can't be read twice
+int input_rewind( Input * input ){
+    if(!input->seekable)
+        return 0;
+    if(input->fp != NULL){
+        if(fseeko(input->fp, 0, SEEK_SET) != 0)
+            return 0;
+        input->len = 0;
+    }
+    input->pos = 0;
+    return 1;
+}
+
+/// Get a stream positioned at the current position of a seekable input
+/// @param input Input to read through a stream
+/// @return Stream positioned at the next unread byte, or NULL for a buffer or unseekable input
+FILE * input_stream( Input * input ){
+    if(!input->seekable || input->fp == NULL)
+        return NULL;
+    off_t offset = input->pos;
+    if(input->map == NULL) // the stream has already read ahead to the end of buf
+        offset = ftello(input->fp) - (off_t)(input->len - input->pos);
+    if(fseeko(input->fp, offset, SEEK_SET) != 0)
+        return NULL;
+    return input->fp;
+}
+
+/// Unmap and close an input
+/// @param input Input to close
+void input_close( Input * input ){
+    if(input->mapped)
+        munmap((void *) input->map, input->size);
+    if(input->fp != NULL && input->fp != stdin)
+        fclose(input->fp);
+    free(input->buf);
+    memset(input, 0, sizeof(Input));
+}
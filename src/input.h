@@ -0,0 +1,83 @@
+//
+// file: input.h
+// description: Definition file for reading input files through a memory mapping
+//
+// @author Daniel Tregea
+//
+
+#ifndef INPUT_H
+#define INPUT_H
+#include <stdio.h>
+#include <stddef.h>
+#include "packman_utils.h"
+
+/// Number of bytes read at a time from input that can't be mapped
+#define INPUT_BUFSIZE  ( 1 << 20 )
+
+/// Input reads a file a chunk at a time. Regular files are mapped into
+/// memory once and every pass walks the same mapping, so no bytes are
+/// copied and no library call is made per byte. Pipes and other inputs
+/// that can't be mapped are read in large buffered chunks instead.
+typedef struct Input_s {
+    FILE * fp;            ///< stream the input was opened with, or NULL for a buffer
+    const uchar * map;    ///< mapped file contents or caller's buffer, or NULL when reading into buf
+    int mapped;           ///< nonzero if map must be unmapped on close
+    size_t size;          ///< number of bytes mapped
+    uchar * buf;          ///< read buffer for input that can't be mapped
+    size_t len;           ///< number of bytes in buf
+    size_t pos;           ///< position of the next unread byte in map or buf
+    int seekable;         ///< nonzero if the input can be rewound
+} Input;
+
+/// Open an input file, mapping it into memory when possible
+/// @param input Input to initialize
+/// @param name Name of the file to open, "-" for stdin
+/// @return 1 on success, 0 if the file can't be opened
+int input_open( Input * input, const char * name );
+
+/// Read a caller's buffer as input, without copying it
+/// @param input Input to initialize
+/// @param data Bytes to read, valid until the input is closed
+/// @param len Number of bytes in data
+void input_open_buffer( Input * input, const uchar * data, size_t len );
+
+/// Look at the unread bytes at the current position without consuming them
+/// @param input Input to peek at
+/// @param data Set to the first unread byte
+/// @return Number of bytes available at data, 0 at the end of the input
+size_t input_peek( Input * input, const uchar ** data );
+
+/// Consume the next chunk of the input
+/// @param input Input to read from
+/// @param max Largest number of bytes to consume
+/// @param data Set to the first byte of the chunk
+/// @return Number of bytes in the chunk, 0 at the end of the input
+size_t input_next( Input * input, size_t max, const uchar ** data );
+
+/// Copy the next bytes of the input into a buffer
+/// @param input Input to read from
+/// @param dst Buffer to copy into
+/// @param len Number of bytes wanted
+/// @return Number of bytes copied, less than len only at the end of the input
+size_t input_read( Input * input, uchar * dst, size_t len );
+
+/// Check whether reading the input failed
+/// @param input Input to check
+/// @return nonzero if a read failed
+int input_error( Input * input );
+
+/// Go back to the start of the input for another pass
+/// @param input Input to rewind
+/// @return 1 on success, 0 if the input can't be read twice
+int input_rewind( Input * input );
+
+/// Get a stream positioned at the current position of a seekable input
+/// @param input Input to read through a stream
+/// @return Stream positioned at the next unread byte, or NULL for a buffer or unseekable input
+FILE * input_stream( Input * input );
+
+/// Unmap and close an input
+/// @param input Input to close
+void input_close( Input * input );
+
+#endif
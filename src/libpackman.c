@@ -0,0 +1,844 @@
+//
+// file: libpackman.c
+// description: Implementation file for the packman library interface
+//
+// @author Daniel Tregea
+//
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libpackman.h"
+#include "packman_utils.h"
+#include "bitio.h"
+#include "blocks.h"
+#include "canonical.h"
+#include "context.h"
+#include "decode.h"
+#include "dynamic.h"
+#include "encode.h"
+#include "input.h"
+#include "output.h"
+#include "stats.h"
+#include "threadpool.h"
+#include "utilities.h"
+
+/// Streaming states of a context
+enum {
+    STREAM_NONE = 0,  ///< no stream started
+    STREAM_ENCODE,    ///< encoding pushed input into block mode
+    STREAM_HEADER,    ///< decoding, waiting for the file header
+    STREAM_BLOCKS,    ///< decoding a block mode file a block at a time
+    STREAM_WHOLE,     ///< decoding, holding the whole file until the stream is finished
+    STREAM_DONE       ///< decoded the end of a block mode file
+};
+
+/// Definition of packman_s
+struct packman_s {
+    Packman_options options;  ///< options to encode and decode with
+    const char * error;       ///< message of the last failure, or NULL
+    int stream;               ///< STREAM_ state of a streaming encode or decode
+    Block_encoder encoder;    ///< block encoder of a streaming encode
+    FILE * out;               ///< stream collecting output until it is pulled
+    Output sink;              ///< buffered output of a decode stream, writing to out
+    char * out_data;          ///< output collected by out
+    size_t out_size;          ///< number of bytes in out_data
+    size_t out_pulled;        ///< number of bytes of out_data already pulled
+    uchar * in_data;          ///< pushed bytes waiting to be decoded
+    size_t in_len;            ///< number of bytes in in_data
+    size_t in_capacity;       ///< number of bytes allocated for in_data
+    size_t in_needed;         ///< number of bytes in_data must hold before the next block is whole
+    uint block_size;          ///< block size of the block mode file being decoded
+    Block_header header;      ///< last block header of the block mode file being decoded
+    Packman_stats stats;      ///< timings and counters of the last encode or decode
+    double stats_started;     ///< clock reading when the last encode or decode started
+};
+
+/// Record a failure on a context
+/// @param ctx The subject Packman
+/// @param message Error message
+/// @return 0
+static int fail( Packman ctx, const char * message ){
+    ctx->error = message;
+    return 0;
+}
+
+/// Get the statistics a context is collecting
+/// @param ctx The subject Packman
+/// @return Statistics to add to, or NULL if the context's options don't collect them
+static Packman_stats * collecting( Packman ctx ){
+    return ctx->options.collect_stats ? &ctx->stats : NULL;
+}
+
+/// Clear the statistics of a context for a new encode or decode
+/// @param ctx The subject Packman
+static void begin_stats( Packman ctx ){
+    Packman_stats * stats = collecting(ctx);
+    if(stats != NULL)
+        memset(stats, 0, sizeof(Packman_stats));
+    ctx->stats_started = stats_start(stats);
+}
+
+/// Finish the statistics of an encode or decode, taking the byte counts
+/// from the positions of its streams where they can be told
+/// @param ctx The subject Packman
+/// @param in Input stream that was read, or NULL
+/// @param out Output stream that was written, or NULL
+static void end_stats( Packman ctx, FILE * in, FILE * out ){
+    Packman_stats * stats = collecting(ctx);
+    if(stats == NULL)
+        return;
+    stats->total_seconds = stats_clock() - ctx->stats_started;
+    off_t offset;
+    if(in != NULL && (offset = ftello(in)) > 0)
+        stats->bytes_in = offset;
+    if(out != NULL && fflush(out) == 0 && (offset = ftello(out)) > 0)
+        stats->bytes_out = offset;
+}
+
+/// Count a code book in the statistics of a context
+/// @param stats Statistics being collected, or NULL
+/// @param book Code book encoded or decoded with
+static void add_book_stats( Packman_stats * stats, const Code_book * book ){
+    if(stats == NULL)
+        return;
+    stats->num_books++;
+    for(int i = 0; i < 256; i++)
+        if(book->length[i] > stats->longest_code)
+            stats->longest_code = book->length[i];
+}
+
+/// Fill options with the defaults: one code stream, no code length limit,
+/// one worker thread per processor
+/// @param options Options to fill
+void packman_default_options( Packman_options * options ){
+    memset(options, 0, sizeof(Packman_options));
+    options->num_threads = tp_default_threads();
+}
+
+/// Create a context
+/// @param options Options to encode and decode with, NULL for the defaults
+/// @return a Packman instance, or NULL on allocation failure
+Packman packman_create( const Packman_options * options ){
+    Packman ctx = calloc(1, sizeof(struct packman_s));
+    if(ctx == NULL)
+        return NULL;
+    if(options != NULL)
+        ctx->options = *options;
+    else
+        packman_default_options(&ctx->options);
+    return ctx;
+}
+
+/// End any stream a context has started
+/// @param ctx The subject Packman
+static void end_stream( Packman ctx ){
+    if(ctx->encoder != NULL)
+        block_encoder_destroy(ctx->encoder);
+    output_close(&ctx->sink);
+    if(ctx->out != NULL)
+        fclose(ctx->out);
+    free(ctx->out_data);
+    free(ctx->in_data);
+    ctx->encoder = NULL;
+    ctx->out = NULL;
+    ctx->out_data = NULL;
+    ctx->out_size = ctx->out_pulled = 0;
+    ctx->in_data = NULL;
+    ctx->in_len = ctx->in_capacity = ctx->in_needed = 0;
+    release_block_header(&ctx->header);
+    ctx->stream = STREAM_NONE;
+}
+
+/// Free a context and anything a streaming encode or decode left behind
+/// @param ctx The subject Packman
+/// @post the ctx reference is no longer valid.
+void packman_destroy( Packman ctx ){
+    if(ctx == NULL)
+        return;
+    end_stream(ctx);
+    free(ctx);
+}
+
+/// Describe the last failure of a context
+/// @param ctx The subject Packman
+/// @return Error message, or NULL if nothing has failed
+const char * packman_error( Packman ctx ){
+    return ctx->error;
+}
+
+/// Get the timings and counters of a context's last encode or decode
+/// @param ctx The subject Packman
+/// @return Statistics, or NULL if the context's options don't collect them
+const Packman_stats * packman_stats( Packman ctx ){
+    return collecting(ctx);
+}
+
+/// Fill the block options of a block mode encode from a context's options
+/// @param ctx The subject Packman
+/// @param block_options Block options to fill
+static void get_block_options( Packman ctx, Block_options * block_options ){
+    const Packman_options * options = &ctx->options;
+    block_options->block_size = options->block_size > 0 ? options->block_size
+                              : options->adaptive ? DEFAULT_ADAPTIVE_BLOCK_SIZE : DEFAULT_BLOCK_SIZE;
+    block_options->num_threads = options->num_threads;
+    block_options->max_length = options->max_length;
+    block_options->interleaved = options->interleaved;
+    block_options->adaptive = options->adaptive && options->sample_size == 0;
+    block_options->sample_size = options->sample_size;
+    block_options->stats = collecting(ctx);
+}
+
+/// Check whether options ask for a block or indexed file
+/// @param options Options to check
+/// @return 1 if a block size, index, interleaving, adaptive books or sampling is asked for, 0 otherwise
+static int uses_blocks( const Packman_options * options ){
+    return options->block_size > 0 || options->indexed || options->interleaved || options->adaptive
+        || options->sample_size > 0;
+}
+
+/// Encode an input in the format the context's options select
+/// @param ctx The subject Packman
+/// @param input Input to encode
+/// @param out Output stream to write the packman file to
+/// @return 1 on success, 0 on failure
+static int encode_format( Packman ctx, Input * input, FILE * out ){
+    const Packman_options * options = &ctx->options;
+    Packman_stats * stats = collecting(ctx);
+    if(options->dynamic){
+        if(uses_blocks(options) || options->context)
+            return fail(ctx, "Dynamic mode can't be combined with blocks, an index or contexts");
+        if(options->max_length > 0 && options->max_length < DYNAMIC_MIN_LENGTH)
+            return fail(ctx, "Code length limit too small");
+        return encode_dynamic(input, out, options->max_length, stats) || fail(ctx, "Can't Write to File");
+    }
+    if(options->context){
+        if(uses_blocks(options))
+            return fail(ctx, "Context mode can't be combined with blocks or an index");
+        if(!input->seekable)
+            return fail(ctx, "Can't read input twice");
+        return encode_context(input, out, options->max_length, stats) || fail(ctx, "Can't encode contexts");
+    }
+
+    // An indexed file's code book is counted over the whole input before it is encoded
+    if(options->indexed && !input->seekable)
+        return fail(ctx, "Indexed output needs a seekable input");
+    if((options->block_size > 0 || options->interleaved || options->adaptive || options->sample_size > 0)
+       && !options->indexed){
+        Block_options block_options;
+        get_block_options(ctx, &block_options);
+        return encode_blocks(input, out, &block_options) || fail(ctx, "Can't encode blocks");
+    }
+
+    // Input that can't be read twice, such as a pipe, is encoded in one pass
+    // with a code book built from its first bytes
+    if(!input->seekable){
+        Block_options block_options;
+        get_block_options(ctx, &block_options);
+        block_options.sample_size = DEFAULT_SAMPLE_SIZE;
+        block_options.adaptive = 0;
+        return encode_blocks(input, out, &block_options) || fail(ctx, "Can't encode blocks");
+    }
+
+    // Read in symbol frequencies
+    uint64_t frequencies[256] = { 0 };
+    double start = stats_start(stats);
+    if(!count_input(input, frequencies))
+        return fail(ctx, "Can't Read File");
+    stats_stop(stats, PACKMAN_PHASE_COUNT, start);
+
+    // Build canonical code book from the huffman tree
+    Code_book book;
+    start = stats_start(stats);
+    if(!build_code_book(frequencies, options->max_length, &book))
+        return fail(ctx, "Can't build huffman codes");
+    stats_stop(stats, PACKMAN_PHASE_BUILD, start);
+
+    // The payload size is known from the frequencies, so the header can be
+    // written before the codes are streamed out
+    uint64_t num_bits_array[1] = { count_code_bits(frequencies, &book) }; // fwrite needs pointer to integer
+    add_book_stats(stats, &book);
+    if(stats != NULL){
+        for(int i = 0; i < 256; i++)
+            stats->num_symbols += frequencies[i];
+        stats->code_bits = num_bits_array[0];
+    }
+    start = stats_start(stats);
+
+    // The codes are a second pass over the same input
+    if(!input_rewind(input))
+        return fail(ctx, "Can't read input twice; use -b");
+
+    // An indexed file shares one code book across blocks found through a trailing index
+    if(options->indexed){
+        size_t block_size = options->block_size > 0 ? options->block_size : DEFAULT_BLOCK_SIZE;
+        int encoded = write_container_header(out, FORMAT_INDEXED)
+                   && write_code_lengths(out, book.length)
+                   && encode_indexed(input, out, &book, block_size);
+        stats_stop(stats, PACKMAN_PHASE_ENCODE, start);
+        return encoded || fail(ctx, "Can't Write to File");
+    }
+
+    // write container header, code lengths, and binary symbol codes
+    if(!write_container_header(out, FORMAT_CANONICAL) || !write_code_lengths(out, book.length)
+       || fwrite(num_bits_array, sizeof(uint64_t), 1, out) != 1)
+        return fail(ctx, "Can't Write to File");
+
+    // Stream the codes through a fixed size buffer of packed words
+    Bit_writer bw;
+    if(!bw_init(&bw, out))
+        return fail(ctx, "Malloc failure");
+    int encoded = encode_input(input, &book, &bw) && bw_flush(&bw);
+    bw_destroy(&bw);
+    stats_stop(stats, PACKMAN_PHASE_ENCODE, start);
+    return encoded || fail(ctx, "Can't Write to File");
+}
+
+/// Encode an input, collecting statistics if the context's options ask for them
+/// @param ctx The subject Packman
+/// @param input Input to encode
+/// @param out Output stream to write the packman file to
+/// @return 1 on success, 0 on failure
+static int encode_to( Packman ctx, Input * input, FILE * out ){
+    begin_stats(ctx);
+    int encoded = encode_format(ctx, input, out);
+    end_stats(ctx, NULL, out);
+    if(collecting(ctx) != NULL)
+        ctx->stats.bytes_in = ctx->stats.num_symbols;
+    return encoded;
+}
+
+/// Decode a code stream and write the symbols to the output stream
+/// @param ctx The subject Packman
+/// @param in Input stream positioned at the first word of the code stream
+/// @param out Output to write the symbols to
+/// @param num_bits Number of code bits in the stream
+/// @param table Decode table for the stream
+/// @return 1 on success, 0 on failure
+static int decode_payload( Packman ctx, FILE * in, Output * out, uint64_t num_bits, Decode_table table ){
+    // Read the symbol code bits a chunk at a time rather than all at once
+    Packman_stats * stats = collecting(ctx);
+    double start = stats_start(stats);
+    Bit_reader br;
+    if(!br_init_stream(&br, in, bits_to_num_uint(num_bits)))
+        return fail(ctx, "Malloc failure");
+    int decoded = (num_bits == 0 || decode_stream(&br, num_bits, table, out) > 0) && !br.truncated;
+    br_destroy(&br);
+    stats_stop(stats, PACKMAN_PHASE_DECODE, start);
+    if(stats != NULL)
+        stats->code_bits += num_bits;
+    return decoded || fail(ctx, "Corrupt encoded data");
+}
+
+/// Decode a file written in the original tree format
+/// @param ctx The subject Packman
+/// @param in Input stream positioned after the magic number
+/// @param out Output to write the symbols to
+/// @return 1 on success, 0 on failure
+static int decode_tree_format( Packman ctx, FILE * in, Output * out ){
+    // Read huffman tree
+    Node_arena arena;
+    arena_reset(&arena);
+    Tree_node huffman_tree = read_tree(in, &arena);
+    if(huffman_tree == NULL)
+        return fail(ctx, "Binary Tree Not Found");
+
+    // Read number of bits
+    uint num_bits_array[1];
+    if(fread(num_bits_array, sizeof(uint), 1, in) == 0)
+        return fail(ctx, "No data found after binary tree");
+
+    // Build decode table from the huffman tree
+    Packman_stats * stats = collecting(ctx);
+    double start = stats_start(stats);
+    Decode_table table = create_decode_table(huffman_tree);
+    if(table == NULL)
+        return fail(ctx, "Binary Tree Not Found");
+    stats_stop(stats, PACKMAN_PHASE_BUILD, start);
+    if(stats != NULL)
+        stats->num_books++;
+
+    int decoded = decode_payload(ctx, in, out, num_bits_array[0], table);
+    free_decode_table(table);
+    return decoded;
+}
+
+/// Decode a file written in the canonical huffman format
+/// @param ctx The subject Packman
+/// @param in Input stream positioned after the format byte
+/// @param out Output to write the symbols to
+/// @return 1 on success, 0 on failure
+static int decode_canonical_format( Packman ctx, FILE * in, Output * out ){
+    // Rebuild the canonical codes from the code lengths
+    Code_book book;
+    if(!read_code_lengths(in, book.length) || !assign_canonical_codes(&book))
+        return fail(ctx, "Code Lengths Not Found");
+
+    // Read number of bits
+    uint64_t num_bits_array[1];
+    if(fread(num_bits_array, sizeof(uint64_t), 1, in) == 0)
+        return fail(ctx, "No data found after code lengths");
+
+    Packman_stats * stats = collecting(ctx);
+    double start = stats_start(stats);
+    Decode_table table = create_book_decode_table(&book);
+    if(table == NULL)
+        return fail(ctx, "Code Lengths Not Found");
+    stats_stop(stats, PACKMAN_PHASE_BUILD, start);
+    add_book_stats(stats, &book);
+
+    int decoded = decode_payload(ctx, in, out, num_bits_array[0], table);
+    free_decode_table(table);
+    return decoded;
+}
+
+/// Decode a file written in the indexed format, one block per worker thread,
+/// or only the blocks holding the requested range. Input without a file
+/// descriptor, such as a buffer, is decoded as one code stream.
+/// @param ctx The subject Packman
+/// @param in Input stream positioned after the format byte
+/// @param out Output to write the symbols to
+/// @return 1 on success, 0 on failure
+static int decode_indexed_format( Packman ctx, FILE * in, Output * out ){
+    Code_book book;
+    if(!read_code_lengths(in, book.length) || !assign_canonical_codes(&book))
+        return fail(ctx, "Code Lengths Not Found");
+    Packman_stats * stats = collecting(ctx);
+    add_book_stats(stats, &book);
+
+    if(fileno(in) >= 0){
+        double start = stats_start(stats);
+        int decoded;
+        if(ctx->options.ranged)
+            decoded = decode_range(in, out, &book, ctx->options.range_offset, ctx->options.range_length);
+        else
+            decoded = decode_indexed(in, out, &book, ctx->options.num_threads);
+        stats_stop(stats, PACKMAN_PHASE_DECODE, start);
+        return decoded || fail(ctx, "Corrupt encoded data");
+    }
+
+    if(ctx->options.ranged)
+        return fail(ctx, "Range decoding needs a file");
+    Block_index index = { NULL, 0, 0, 0 };
+    Decode_table table = create_book_decode_table(&book);
+    int decoded = table != NULL && read_block_index(in, &index)
+               && fseeko(in, index.payload_offset, SEEK_SET) == 0;
+    free(index.entries);
+    decoded = decoded ? decode_payload(ctx, in, out, index.num_bits, table) : fail(ctx, "Corrupt encoded data");
+    free_decode_table(table);
+    return decoded;
+}
+
+/// Decode a packman file of any format
+/// @param ctx The subject Packman
+/// @param in Input stream positioned at the magic number
+/// @param out Output to write the symbols to
+/// @return 1 on success, 0 on failure
+static int decode_format( Packman ctx, FILE * in, Output * out ){
+    uchar head[2];
+    ushort magic;
+    int encoded = find_packman_magic(head, fread(head, sizeof(uchar), 2, in), &magic);
+    if(encoded < 0)
+        return fail(ctx, "File has no contents");
+    if(encoded > 0)
+        return fail(ctx, "Not a packman file");
+
+    // Versioned containers name their format in the byte after the magic number
+    uchar format[1] = { 0 };
+    if(magic == PACKMAN_MAGIC_V2 && fread(format, sizeof(uchar), 1, in) != 1)
+        return fail(ctx, "Unknown packman format");
+
+    if(ctx->options.ranged && format[0] != FORMAT_INDEXED)
+        return fail(ctx, "Range decoding needs an indexed file");
+    if(magic == PACKMAN_MAGIC)
+        return decode_tree_format(ctx, in, out);
+    if(format[0] == FORMAT_CANONICAL)
+        return decode_canonical_format(ctx, in, out);
+    if(format[0] == FORMAT_BLOCKS)
+        return decode_blocks(in, out, collecting(ctx)) || fail(ctx, "Corrupt encoded data");
+    if(format[0] == FORMAT_INDEXED)
+        return decode_indexed_format(ctx, in, out);
+    if(format[0] == FORMAT_DYNAMIC)
+        return decode_dynamic(in, out, collecting(ctx)) || fail(ctx, "Corrupt encoded data");
+    if(format[0] == FORMAT_CONTEXT)
+        return decode_context(in, out, collecting(ctx)) || fail(ctx, "Corrupt encoded data");
+    return fail(ctx, "Unknown packman format");
+}
+
+/// Decode a packman file, collecting statistics if the context's options ask for them
+/// @param ctx The subject Packman
+/// @param in Input stream positioned at the magic number
+/// @param out Output to write the symbols to
+/// @return 1 on success, 0 on failure
+static int decode_from( Packman ctx, FILE * in, Output * out ){
+    begin_stats(ctx);
+    int decoded = decode_format(ctx, in, out);
+    end_stats(ctx, in, NULL);
+    if(collecting(ctx) != NULL)
+        ctx->stats.bytes_out = output_size(out);
+
+    // Formats without symbol counts decode one symbol per output byte
+    if(collecting(ctx) != NULL && ctx->stats.num_symbols == 0)
+        ctx->stats.num_symbols = ctx->stats.bytes_out;
+    return decoded;
+}
+
+/// Encode a buffer into a newly allocated packman file image
+/// @param ctx The subject Packman
+/// @param src Bytes to encode
+/// @param len Number of bytes in src
+/// @param dst Set to the encoded bytes, to be released with free
+/// @param dst_len Set to the number of encoded bytes
+/// @return 1 on success, 0 on failure
+int packman_encode_buffer( Packman ctx, const unsigned char * src, size_t len,
+                           unsigned char ** dst, size_t * dst_len ){
+    if(src == NULL || len == 0)
+        return fail(ctx, "File has no contents");
+    char * data = NULL;
+    size_t size = 0;
+    FILE * out = open_memstream(&data, &size);
+    if(out == NULL)
+        return fail(ctx, "Malloc failure");
+    Input input;
+    input_open_buffer(&input, src, len);
+    int encoded = encode_to(ctx, &input, out);
+    input_close(&input);
+    if(fclose(out) != 0 && encoded)
+        encoded = fail(ctx, "Malloc failure");
+    if(!encoded){
+        free(data);
+        return 0;
+    }
+    *dst = (unsigned char *) data;
+    *dst_len = size;
+    return 1;
+}
+
+/// Decode a packman file image into a newly allocated buffer
+/// @param ctx The subject Packman
+/// @param src Packman file image to decode
+/// @param len Number of bytes in src
+/// @param dst Set to the decoded bytes, to be released with free
+/// @param dst_len Set to the number of decoded bytes
+/// @return 1 on success, 0 on failure
+int packman_decode_buffer( Packman ctx, const unsigned char * src, size_t len,
+                           unsigned char ** dst, size_t * dst_len ){
+    if(len == 0)
+        return fail(ctx, "File has no contents");
+    FILE * in = fmemopen((void *) src, len, "rb");
+    char * data = NULL;
+    size_t size = 0;
+    FILE * out = in == NULL ? NULL : open_memstream(&data, &size);
+    Output sink;
+    if(out == NULL || !output_open_stream(&sink, out)){
+        if(in != NULL)
+            fclose(in);
+        if(out != NULL)
+            fclose(out);
+        free(data);
+        return fail(ctx, "Malloc failure");
+    }
+    int decoded = decode_from(ctx, in, &sink);
+    fclose(in);
+    if((!output_close(&sink) || fclose(out) != 0) && decoded)
+        decoded = fail(ctx, "Malloc failure");
+    if(!decoded){
+        free(data);
+        return 0;
+    }
+    *dst = (unsigned char *) data;
+    *dst_len = size;
+    return 1;
+}
+
+/// Pull every byte of waiting stream output into an output
+/// @param ctx The subject Packman
+/// @param out Output to write to
+/// @return 1 on success, 0 on a write failure
+static int drain_to( Packman ctx, Output * out ){
+    uchar buf[BUFSIZE * 64];
+    size_t len;
+    while((len = packman_pull(ctx, buf, sizeof(buf))) > 0)
+        if(!output_write(out, buf, len))
+            return fail(ctx, "Can't Write to File");
+    return 1;
+}
+
+/// Decode an opened input, streaming it through the context when it
+/// can't be read through a seekable stream
+/// @param ctx The subject Packman
+/// @param input Input positioned at the magic number
+/// @param output_file Name of the output file, "-" for stdout
+/// @return 1 on success, 0 on failure
+static int decode_input( Packman ctx, Input * input, const char * output_file ){
+    FILE * in = input_stream(input);
+    Output sink, * out = &sink;
+    if(!output_open(out, output_file, ctx->options.direct))
+        return fail(ctx, "Can't Write to File");
+    output_start_writer(out);
+    int decoded;
+    if(in != NULL)
+        decoded = decode_from(ctx, in, out);
+    else if(ctx->options.ranged)
+        decoded = fail(ctx, "Range decoding needs a file");
+    else{
+        const uchar * data;
+        size_t len;
+        decoded = packman_begin_decode(ctx);
+        while(decoded && (len = input_next(input, INPUT_BUFSIZE, &data)) > 0)
+            decoded = packman_push(ctx, data, len) && drain_to(ctx, out);
+        decoded = decoded && (!input_error(input) || fail(ctx, "Can't Read File"))
+               && packman_finish(ctx) && drain_to(ctx, out);
+        end_stream(ctx);
+    }
+    if(!output_close(out) && decoded)
+        decoded = fail(ctx, "Can't Write to File");
+    return decoded;
+}
+
+/// Encode an opened input to an output file
+/// @param ctx The subject Packman
+/// @param input Input positioned at its first byte
+/// @param output_file Name of the output file, "-" for stdout
+/// @return 1 on success, 0 on failure
+static int encode_input_file( Packman ctx, Input * input, const char * output_file ){
+    FILE * out = get_output_stream((char *) output_file);
+    if(out == NULL)
+        return fail(ctx, "Can't Write to File");
+    int encoded = encode_to(ctx, input, out);
+    if(fclose(out) != 0 && encoded)
+        encoded = fail(ctx, "Can't Write to File");
+    return encoded;
+}
+
+/// Encode a file
+/// @param ctx The subject Packman
+/// @param input_file Name of the file to encode, "-" for stdin
+/// @param output_file Name of the output file, "-" for stdout
+/// @return 1 on success, 0 on failure
+int packman_encode_file( Packman ctx, const char * input_file, const char * output_file ){
+    Input input;
+    if(!input_open(&input, input_file))
+        return fail(ctx, "NoSuchFile");
+    int encoded = encode_input_file(ctx, &input, output_file);
+    input_close(&input);
+    return encoded;
+}
+
+/// Decode a packman file
+/// @param ctx The subject Packman
+/// @param input_file Name of the file to decode, "-" for stdin
+/// @param output_file Name of the output file, "-" for stdout
+/// @return 1 on success, 0 on failure
+int packman_decode_file( Packman ctx, const char * input_file, const char * output_file ){
+    Input input;
+    if(!input_open(&input, input_file))
+        return fail(ctx, "NoSuchFile");
+    int decoded = decode_input(ctx, &input, output_file);
+    input_close(&input);
+    return decoded;
+}
+
+/// Decode a packman file, or encode any other file
+/// @param ctx The subject Packman
+/// @param input_file Name of the file to read, "-" for stdin
+/// @param output_file Name of the output file, "-" for stdout
+/// @return 1 on success, 0 on failure
+int packman_process_file( Packman ctx, const char * input_file, const char * output_file ){
+    Input input;
+    if(!input_open(&input, input_file))
+        return fail(ctx, "NoSuchFile");
+
+    // Determine whether to encode or decode depending on magic number
+    const uchar * head;
+    ushort magic;
+    size_t head_len = input_peek(&input, &head);
+    int encode = find_packman_magic(head, head_len, &magic);
+    int status;
+    if(encode < 0)
+        status = fail(ctx, "File has no contents");
+    else if(encode)
+        status = encode_input_file(ctx, &input, output_file);
+    else
+        status = decode_input(ctx, &input, output_file);
+    input_close(&input);
+    return status;
+}
+
+/// Start collecting stream output
+/// @param ctx The subject Packman
+/// @param stream STREAM_ state to start in
+/// @return 1 on success, 0 on allocation failure
+static int begin_stream( Packman ctx, int stream ){
+    end_stream(ctx);
+    ctx->error = NULL;
+    ctx->out = open_memstream(&ctx->out_data, &ctx->out_size);
+    if(ctx->out == NULL)
+        return fail(ctx, "Malloc failure");
+    ctx->stream = stream;
+    begin_stats(ctx);
+    return 1;
+}
+
+/// Start encoding pushed input. A stream is always encoded in block mode,
+/// so output is ready to pull as each batch of blocks is compressed.
+/// @param ctx The subject Packman
+/// @return 1 on success, 0 on failure
+int packman_begin_encode( Packman ctx ){
+    if(!begin_stream(ctx, STREAM_ENCODE))
+        return 0;
+    Block_options block_options;
+    get_block_options(ctx, &block_options);
+    ctx->encoder = block_encoder_create(ctx->out, &block_options);
+    return ctx->encoder != NULL || fail(ctx, "Can't encode blocks");
+}
+
+/// Start decoding pushed packman file bytes. Block mode files are decoded
+/// a block at a time as the blocks arrive; other formats are decoded once
+/// the stream is finished.
+/// @param ctx The subject Packman
+/// @return 1 on success, 0 on failure
+int packman_begin_decode( Packman ctx ){
+    if(!begin_stream(ctx, STREAM_HEADER))
+        return 0;
+    return output_open_stream(&ctx->sink, ctx->out) || fail(ctx, "Malloc failure");
+}
+
+/// Decode whatever complete parts of a block mode file have been pushed
+/// @param ctx The subject Packman
+/// @return 1 on success, 0 on a malformed file
+static int decode_pushed( Packman ctx ){
+    size_t pos = 0;
+    if(ctx->stream == STREAM_HEADER && ctx->in_len >= 2){
+        ushort magic;
+        if(find_packman_magic(ctx->in_data, ctx->in_len, &magic) != 0)
+            return fail(ctx, "Not a packman file");
+        if(magic == PACKMAN_MAGIC || (ctx->in_len >= 3 && ctx->in_data[2] != FORMAT_BLOCKS))
+            ctx->stream = STREAM_WHOLE;
+        else if(ctx->in_len >= 3 + sizeof(uint)){
+            memcpy(&ctx->block_size, ctx->in_data + 3, sizeof(uint));
+            pos = 3 + sizeof(uint);
+            ctx->stream = STREAM_BLOCKS;
+        }
+    }
+
+    // Decode each block once all of its bytes have arrived
+    int ok = 1, waiting = 0;
+    while(ok && !waiting && ctx->stream == STREAM_BLOCKS && pos < ctx->in_len && ctx->in_len >= ctx->in_needed){
+        FILE * in = fmemopen(ctx->in_data + pos, ctx->in_len - pos, "rb");
+        if(in == NULL)
+            return fail(ctx, "Malloc failure");
+        Block_header * header = &ctx->header;
+        if(!read_block_header(in, header)){
+            waiting = feof(in); // the header hasn't fully arrived yet
+            ok = waiting || fail(ctx, "Corrupt encoded data");
+        } else if(header->flags & BLOCK_END){
+            ctx->stream = STREAM_DONE;
+            pos++;
+        } else if(!block_header_in_bounds(header, ctx->block_size)){
+            ok = fail(ctx, "Corrupt encoded data"); // don't wait for code words that can't exist
+        } else{
+            size_t header_len = (size_t) ftello(in);
+            ctx->in_needed = pos + header_len + header->num_words * sizeof(uint);
+            if(ctx->in_len < ctx->in_needed)
+                waiting = 1;
+            else if(!decode_block(in, &ctx->sink, header, ctx->block_size, collecting(ctx)))
+                ok = fail(ctx, "Corrupt encoded data");
+            else
+                pos = ctx->in_needed;
+        }
+        fclose(in);
+    }
+
+    if(pos > 0){
+        memmove(ctx->in_data, ctx->in_data + pos, ctx->in_len - pos);
+        ctx->in_len -= pos;
+        ctx->in_needed = ctx->in_needed > pos ? ctx->in_needed - pos : 0;
+    }
+    return ok;
+}
+
+/// Feed the next bytes of a stream
+/// @param ctx The subject Packman
+/// @param data Bytes to feed
+/// @param len Number of bytes in data
+/// @return 1 on success, 0 on failure
+int packman_push( Packman ctx, const unsigned char * data, size_t len ){
+    if(ctx->stream == STREAM_NONE || ctx->error != NULL)
+        return fail(ctx, ctx->error != NULL ? ctx->error : "No stream started");
+    if(collecting(ctx) != NULL)
+        ctx->stats.bytes_in += len;
+    if(ctx->stream == STREAM_ENCODE)
+        return block_encoder_push(ctx->encoder, data, len) || fail(ctx, "Can't encode blocks");
+    if(ctx->stream == STREAM_DONE)
+        return len == 0 || fail(ctx, "Data after the end of the file");
+
+    if(ctx->in_len + len > ctx->in_capacity){
+        size_t capacity = ctx->in_capacity > 0 ? ctx->in_capacity : INPUT_BUFSIZE;
+        while(capacity < ctx->in_len + len)
+            capacity *= 2;
+        uchar * grown = realloc(ctx->in_data, capacity);
+        if(grown == NULL)
+            return fail(ctx, "Malloc failure");
+        ctx->in_data = grown;
+        ctx->in_capacity = capacity;
+    }
+    memcpy(ctx->in_data + ctx->in_len, data, len);
+    ctx->in_len += len;
+    return decode_pushed(ctx);
+}
+
+/// Mark the end of a stream and produce the rest of its output
+/// @param ctx The subject Packman
+/// @return 1 on success, 0 on failure or a truncated packman file
+int packman_finish( Packman ctx ){
+    if(ctx->error != NULL)
+        return 0;
+    if(collecting(ctx) != NULL)
+        ctx->stats.total_seconds = stats_clock() - ctx->stats_started;
+    if(ctx->stream == STREAM_ENCODE)
+        return block_encoder_finish(ctx->encoder) || fail(ctx, "Can't encode blocks");
+    if(ctx->stream == STREAM_DONE)
+        return 1;
+    if(ctx->stream == STREAM_BLOCKS)
+        return fail(ctx, "Corrupt encoded data");
+    if(ctx->stream == STREAM_NONE)
+        return fail(ctx, "No stream started");
+
+    // Formats other than block mode are decoded whole
+    if(ctx->in_len == 0)
+        return fail(ctx, "File has no contents");
+    FILE * in = fmemopen(ctx->in_data, ctx->in_len, "rb");
+    if(in == NULL)
+        return fail(ctx, "Malloc failure");
+    int decoded = decode_from(ctx, in, &ctx->sink);
+    fclose(in);
+    ctx->stream = STREAM_DONE;
+    return decoded;
+}
+
+/// Take output produced so far by a stream
+/// @param ctx The subject Packman
+/// @param out Buffer to copy output into
+/// @param capacity Number of bytes out can hold
+/// @return Number of bytes copied, 0 once no output is waiting
+size_t packman_pull( Packman ctx, unsigned char * out, size_t capacity ){
+    if(ctx->out == NULL || (ctx->sink.buf != NULL && !output_flush(&ctx->sink)) || fflush(ctx->out) != 0)
+        return 0;
+    size_t len = ctx->out_size - ctx->out_pulled;
+    if(len > capacity)
+        len = capacity;
+    memcpy(out, ctx->out_data + ctx->out_pulled, len);
+    ctx->out_pulled += len;
+    if(collecting(ctx) != NULL)
+        ctx->stats.bytes_out += len;
+
+    // Write over the output buffer once everything has been taken;
+    // the stream's size follows its position
+    if(ctx->out_pulled == ctx->out_size && ctx->out_size > 0){
+        fseeko(ctx->out, 0, SEEK_SET);
+        ctx->out_pulled = 0;
+    }
+    return len;
+}
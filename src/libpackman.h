@@ -0,0 +1,162 @@
+//
+// file: libpackman.h
+// description: Definition file for the packman library interface
+//
+// @author Daniel Tregea
+//
+
+#ifndef LIBPACKMAN_H
+#define LIBPACKMAN_H
+#include <stddef.h>
+#include <stdint.h>
+
+/// Phases of an encode or decode timed in Packman_stats
+enum {
+    PACKMAN_PHASE_READ,    ///< reading input that isn't mapped into memory
+    PACKMAN_PHASE_COUNT,   ///< counting symbol frequencies
+    PACKMAN_PHASE_BUILD,   ///< building code books and decode tables
+    PACKMAN_PHASE_ENCODE,  ///< packing codes, and writing them for a single code stream
+    PACKMAN_PHASE_DECODE,  ///< reading and decoding codes, and writing the symbols
+    PACKMAN_PHASE_WRITE,   ///< writing compressed blocks
+    PACKMAN_NUM_PHASES
+};
+
+/// Packman_stats holds the timings and counters of a context's last encode
+/// or decode. Phases run on worker threads are summed over the workers.
+typedef struct Packman_stats_s {
+    double seconds[PACKMAN_NUM_PHASES];  ///< time spent in each PACKMAN_PHASE_
+    double total_seconds;                ///< wall time of the whole encode or decode
+    uint64_t bytes_in;                   ///< bytes read, 0 if unknown
+    uint64_t bytes_out;                  ///< bytes written, 0 if unknown
+    uint64_t num_symbols;                ///< symbols encoded or decoded
+    uint64_t code_bits;                  ///< code bits written or read
+    uint64_t num_blocks;                 ///< blocks of a block mode file
+    uint64_t num_books;                  ///< code books built or read
+    unsigned longest_code;               ///< longest code length, the depth of the deepest tree
+} Packman_stats;
+
+/// Packman_options selects how a context encodes and decodes
+typedef struct Packman_options_s {
+    unsigned max_length;    ///< longest code length to encode with, 0 for no limit
+    size_t block_size;      ///< bytes per block in block mode, 0 for one code stream
+    int num_threads;        ///< worker threads for block encoding and indexed decoding
+    int indexed;            ///< nonzero to write one code stream with a block index
+    int interleaved;        ///< nonzero to code each block as four interleaved streams
+    int ranged;             ///< nonzero to decode only range_offset..range_length of a file
+    uint64_t range_offset;  ///< first byte of the original file to decode
+    uint64_t range_length;  ///< number of bytes of the original file to decode
+    int adaptive;           ///< nonzero to end blocks where the symbol statistics change,
+                            ///< making block_size the largest block
+    int collect_stats;      ///< nonzero to record Packman_stats; without it nothing is timed
+    int direct;             ///< nonzero to write decoded files with O_DIRECT, bypassing the page cache
+    size_t sample_size;     ///< leading bytes to build one code book from in a single pass, 0 to read
+                            ///< the input twice or build a code book per block
+    int dynamic;            ///< nonzero to code in one pass with a code book the decoder rebuilds
+                            ///< in step, storing no code book
+    int context;            ///< nonzero to code each byte with a code book chosen by the byte before it
+} Packman_options;
+
+/// Packman is a context holding options, the last error and the state of
+/// a streaming encode or decode. Contexts share nothing, so each thread
+/// can use its own.
+typedef struct packman_s * Packman;
+
+/// Fill options with the defaults: one code stream, no code length limit,
+/// one worker thread per processor
+/// @param options Options to fill
+void packman_default_options( Packman_options * options );
+
+/// Create a context
+/// @param options Options to encode and decode with, NULL for the defaults
+/// @return a Packman instance, or NULL on allocation failure
+Packman packman_create( const Packman_options * options );
+
+/// Free a context and anything a streaming encode or decode left behind
+/// @param ctx The subject Packman
+/// @post the ctx reference is no longer valid.
+void packman_destroy( Packman ctx );
+
+/// Describe the last failure of a context
+/// @param ctx The subject Packman
+/// @return Error message, or NULL if nothing has failed
+const char * packman_error( Packman ctx );
+
+/// Get the timings and counters of a context's last encode or decode
+/// @param ctx The subject Packman
+/// @return Statistics, or NULL if the context's options don't collect them
+const Packman_stats * packman_stats( Packman ctx );
+
+/// Encode a buffer into a newly allocated packman file image
+/// @param ctx The subject Packman
+/// @param src Bytes to encode
+/// @param len Number of bytes in src
+/// @param dst Set to the encoded bytes, to be released with free
+/// @param dst_len Set to the number of encoded bytes
+/// @return 1 on success, 0 on failure
+int packman_encode_buffer( Packman ctx, const unsigned char * src, size_t len,
+                           unsigned char ** dst, size_t * dst_len );
+
+/// Decode a packman file image into a newly allocated buffer
+/// @param ctx The subject Packman
+/// @param src Packman file image to decode
+/// @param len Number of bytes in src
+/// @param dst Set to the decoded bytes, to be released with free
+/// @param dst_len Set to the number of decoded bytes
+/// @return 1 on success, 0 on failure
+int packman_decode_buffer( Packman ctx, const unsigned char * src, size_t len,
+                           unsigned char ** dst, size_t * dst_len );
+
+/// Encode a file
+/// @param ctx The subject Packman
+/// @param input_file Name of the file to encode, "-" for stdin
+/// @param output_file Name of the output file, "-" for stdout
+/// @return 1 on success, 0 on failure
+int packman_encode_file( Packman ctx, const char * input_file, const char * output_file );
+
+/// Decode a packman file
+/// @param ctx The subject Packman
+/// @param input_file Name of the file to decode, "-" for stdin
+/// @param output_file Name of the output file, "-" for stdout
+/// @return 1 on success, 0 on failure
+int packman_decode_file( Packman ctx, const char * input_file, const char * output_file );
+
+/// Decode a packman file, or encode any other file
+/// @param ctx The subject Packman
+/// @param input_file Name of the file to read, "-" for stdin
+/// @param output_file Name of the output file, "-" for stdout
+/// @return 1 on success, 0 on failure
+int packman_process_file( Packman ctx, const char * input_file, const char * output_file );
+
+/// Start encoding pushed input. A stream is always encoded in block mode,
+/// so output is ready to pull as each batch of blocks is compressed.
+/// @param ctx The subject Packman
+/// @return 1 on success, 0 on failure
+int packman_begin_encode( Packman ctx );
+
+/// Start decoding pushed packman file bytes. Block mode files are decoded
+/// a block at a time as the blocks arrive; other formats are decoded once
+/// the stream is finished.
+/// @param ctx The subject Packman
+/// @return 1 on success, 0 on failure
+int packman_begin_decode( Packman ctx );
+
+/// Feed the next bytes of a stream
+/// @param ctx The subject Packman
+/// @param data Bytes to feed
+/// @param len Number of bytes in data
+/// @return 1 on success, 0 on failure
+int packman_push( Packman ctx, const unsigned char * data, size_t len );
+
+/// Mark the end of a stream and produce the rest of its output
+/// @param ctx The subject Packman
+/// @return 1 on success, 0 on failure or a truncated packman file
+int packman_finish( Packman ctx );
+
+/// Take output produced so far by a stream
+/// @param ctx The subject Packman
+/// @param out Buffer to copy output into
+/// @param capacity Number of bytes out can hold
+/// @return Number of bytes copied, 0 once no output is waiting
+size_t packman_pull( Packman ctx, unsigned char * out, size_t capacity );
+
+#endif
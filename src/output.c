@@ -0,0 +1,397 @@
+//
+// file: output.c
+// description: Implementation file for writing decoded output through large aligned buffers
+//
+// @author Daniel Tregea
+//
+
+#define _GNU_SOURCE  // O_DIRECT and F_SETPIPE_SZ
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "output.h"
+
+#ifndef O_DIRECT
+#define O_DIRECT  0
+#endif
+
+/// Alignment of the buffer, and of every write to a file opened with O_DIRECT
+#define OUTPUT_ALIGN  4096
+
+/// Set up an output and allocate its buffer
+/// @param out Output to initialize
+/// @param fp Stream to write to, or NULL
+/// @param fd File descriptor to write to, or -1
+/// @return 1 on success, 0 on allocation failure
+static int output_init( Output * out, FILE * fp, int fd ){
+    memset(out, 0, sizeof(Output));
+    out->fp = fp;
+    out->fd = fd;
+    void * buf;
+    if(posix_memalign(&buf, OUTPUT_ALIGN, OUTPUT_BUFSIZE) != 0)
+        return 0;
+    out->chunk = &out->chunks[0];
+    out->chunk->data = out->buf = buf;
+    out->chunk->ok = 1;
+
+    struct stat st;
+    off_t offset;
+    if(fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (offset = lseek(fd, 0, SEEK_CUR)) >= 0){
+        out->seekable = 1;
+        out->base = offset;
+    }
+    return 1;
+}
+
+/// Open an output file for writing through its file descriptor
+/// @param out Output to initialize
+/// @param name Name of the file to create, "-" for stdout
+/// @param direct Nonzero to open a file with O_DIRECT where the file system allows it
+/// @return 1 on success, 0 if the file can't be created or on allocation failure
+int output_open( Output * out, const char * name, int direct ){
+    if(strcmp(name, "-") == 0){
+        // Bytes written to stdout through stdio would come out of order
+        fflush(stdout);
+        if(!output_init(out, NULL, STDOUT_FILENO))
+            return 0;
+#ifdef F_SETPIPE_SZ
+        // A pipe as large as the buffer takes each write without waking
+        // the reader part way through; failing to grow it is harmless
+        struct stat st;
+        if(fstat(STDOUT_FILENO, &st) == 0 && S_ISFIFO(st.st_mode))
+            fcntl(STDOUT_FILENO, F_SETPIPE_SZ, OUTPUT_BUFSIZE);
+#endif
+        return 1;
+    }
+
+    // File systems without O_DIRECT refuse it, so fall back to the page cache
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    int fd = direct && O_DIRECT != 0 ? open(name, flags | O_DIRECT, 0666) : -1;
+    int is_direct = fd >= 0;
+    if(fd < 0 && (fd = open(name, flags, 0666)) < 0)
+        return 0;
+    if(!output_init(out, NULL, fd)){
+        close(fd);
+        return 0;
+    }
+    out->owned = 1;
+    out->direct = is_direct;
+    return 1;
+}
+
+/// Write to a stream through an output's buffer
+/// @param out Output to initialize
+/// @param fp Stream to write to, still owned by the caller
+/// @return 1 on success, 0 on allocation failure
+int output_open_stream( Output * out, FILE * fp ){
+    return output_init(out, fp, -1);
+}
+
+/// Write every byte of a buffer to a stream or file descriptor
+/// @param fp Stream to write to, or NULL
+/// @param fd File descriptor to write to when fp is NULL
+/// @param data Bytes to write
+/// @param len Number of bytes in data
+/// @return 1 on success, 0 on a write error
+static int write_all( FILE * fp, int fd, const uchar * data, size_t len ){
+    if(fp != NULL)
+        return fwrite(data, sizeof(uchar), len, fp) == len;
+    while(len > 0){
+        ssize_t num_written = write(fd, data, len);
+        if(num_written < 0 && errno == EINTR)
+            continue;
+        if(num_written <= 0)
+            return 0;
+        data += num_written;
+        len -= num_written;
+    }
+    return 1;
+}
+
+/// Write bytes in place, counting them or marking the output failed
+/// @param out Output to write to
+/// @param data Bytes to write
+/// @param len Number of bytes in data
+/// @return 1 on success, 0 on a write error
+static int write_full( Output * out, const uchar * data, size_t len ){
+    if(!write_all(out->fp, out->fd, data, len)){
+        out->error = 1;
+        return 0;
+    }
+    out->written += len;
+    return 1;
+}
+
+/// Hand the first bytes of the buffer to the writer thread and go on
+/// filling the next free buffer, starting with the bytes left over
+/// @param out Output with a writer thread
+/// @param len Number of bytes to hand over
+/// @return 1 on success, 0 if an earlier write of the next buffer failed
+static int hand_off( Output * out, size_t len ){
+    Output_chunk * chunk = out->chunk;
+    chunk->len = len;
+    ring_push(out->full, chunk);
+    out->written += len;
+
+    // The writer only reads the bytes handed to it, so the rest can be copied
+    Output_chunk * next = ring_pop(out->empty);
+    out->len -= len;
+    memcpy(next->data, chunk->data + len, out->len);
+    out->chunk = next;
+    out->buf = next->data;
+    if(!next->ok)
+        out->error = 1;
+    return next->ok;
+}
+
+/// Write the buffer out, or hand it to the writer thread if there is one.
+/// O_DIRECT writes must be whole aligned blocks, so a partial block stays
+/// buffered until the final flush, which writes it after turning O_DIRECT off.
+/// @param out Output to write out
+/// @param final Nonzero to write every buffered byte
+/// @return 1 on success, 0 on a write error
+static int drain( Output * out, int final ){
+    size_t len = out->len;
+    if(out->direct)
+        len -= len % OUTPUT_ALIGN;
+    if(len > 0 && out->full != NULL)
+        return hand_off(out, len);
+    if(len > 0 && !write_full(out, out->buf, len))
+        return 0;
+    out->len -= len;
+    if(out->len > 0)
+        memmove(out->buf, out->buf + len, out->len);
+    if(final && out->len > 0){
+        int flags = fcntl(out->fd, F_GETFL);
+        if(flags == -1 || fcntl(out->fd, F_SETFL, flags & ~O_DIRECT) == -1){
+            out->error = 1;
+            return 0;
+        }
+        out->direct = 0;
+        if(!write_full(out, out->buf, out->len))
+            return 0;
+        out->len = 0;
+    }
+    return 1;
+}
+
+/// Write the output's buffers handed over by hand_off until given NULL
+/// @param arg The Output to write
+/// @return NULL
+static void * chunk_writer( void * arg ){
+    Output * out = arg;
+    Output_chunk * chunk;
+    while((chunk = ring_pop(out->full)) != NULL){
+        chunk->ok = chunk->ok && write_all(out->fp, out->fd, chunk->data, chunk->len);
+        ring_push(out->empty, chunk);
+    }
+    return NULL;
+}
+
+/// Free the extra buffers and rings of a writer thread
+/// @param out Output whose writer thread has stopped or never started
+static void free_writer( Output * out ){
+    if(out->full != NULL)
+        ring_destroy(out->full);
+    if(out->empty != NULL)
+        ring_destroy(out->empty);
+    out->full = out->empty = NULL;
+}
+
+/// Write the output's buffers on a writer thread from now until it is
+/// flushed. If the thread can't be started, writes happen in place.
+/// @param out Output opened with output_open
+void output_start_writer( Output * out ){
+    // One slot more than the buffers leaves room for the NULL that stops the writer
+    out->full = ring_create(OUTPUT_BUFFERS + 1);
+    out->empty = ring_create(OUTPUT_BUFFERS);
+    int ok = out->full != NULL && out->empty != NULL;
+    for(int i = 0; ok && i < OUTPUT_BUFFERS; i++){
+        Output_chunk * chunk = &out->chunks[i];
+        void * buf;
+        if(chunk == out->chunk || chunk->data != NULL)
+            continue;
+        ok = posix_memalign(&buf, OUTPUT_ALIGN, OUTPUT_BUFSIZE) == 0;
+        chunk->data = ok ? buf : NULL;
+        chunk->ok = 1;
+    }
+    for(int i = 0; ok && i < OUTPUT_BUFFERS; i++)
+        if(&out->chunks[i] != out->chunk)
+            ring_push(out->empty, &out->chunks[i]);
+    if(!ok || pthread_create(&out->writer, NULL, chunk_writer, out) != 0)
+        free_writer(out);
+}
+
+/// Wait for the writer thread to write every buffer handed to it, and stop it
+/// @param out Output with a writer thread
+static void stop_writer( Output * out ){
+    ring_push(out->full, NULL);
+    pthread_join(out->writer, NULL);
+    free_writer(out);
+    for(int i = 0; i < OUTPUT_BUFFERS; i++)
+        if(out->chunks[i].data != NULL && !out->chunks[i].ok)
+            out->error = 1;
+}
+
+/// Write the buffer and then a caller's bytes with one writev
+/// @param out Output writing a file descriptor without O_DIRECT
+/// @param data Bytes to write after the buffered bytes
+/// @param len Number of bytes in data
+/// @return 1 on success, 0 on a write error
+static int write_vector( Output * out, const uchar * data, size_t len ){
+    struct iovec iov[2] = { { out->buf, out->len }, { (void *) data, len } };
+    struct iovec * next = out->len > 0 ? iov : iov + 1;
+    int count = out->len > 0 ? 2 : 1;
+    while(count > 0){
+        ssize_t num_written = writev(out->fd, next, count);
+        if(num_written < 0 && errno == EINTR)
+            continue;
+        if(num_written <= 0){
+            out->error = 1;
+            return 0;
+        }
+        out->written += num_written;
+
+        // Step past whatever a short write did take
+        while(count > 0 && (size_t) num_written >= next->iov_len){
+            num_written -= next->iov_len;
+            next++;
+            count--;
+        }
+        if(count > 0){
+            next->iov_base = (char *) next->iov_base + num_written;
+            next->iov_len -= num_written;
+        }
+    }
+    out->len = 0;
+    return 1;
+}
+
+/// Copy bytes into the output, writing the buffer out as it fills.
+/// Large writes go straight from data, together with any buffered bytes.
+/// @param out Output to write to
+/// @param data Bytes to write
+/// @param len Number of bytes in data
+/// @return 1 on success, 0 on a write error
+int output_write( Output * out, const uchar * data, size_t len ){
+    if(out->error)
+        return 0;
+    if(len >= OUTPUT_BUFSIZE - out->len && !out->direct && out->full == NULL){
+        if(out->fp == NULL)
+            return write_vector(out, data, len);
+        return drain(out, 1) && write_full(out, data, len);
+    }
+    while(len > 0){
+        size_t room = OUTPUT_BUFSIZE - out->len;
+        size_t num_copied = len < room ? len : room;
+        memcpy(out->buf + out->len, data, num_copied);
+        out->len += num_copied;
+        data += num_copied;
+        len -= num_copied;
+        if(out->len == OUTPUT_BUFSIZE && !drain(out, 0))
+            return 0;
+    }
+    return 1;
+}
+
+/// Get room in the buffer to produce bytes into directly, writing the
+/// buffer out first if it holds fewer than want free bytes
+/// @param out Output to write to
+/// @param want Number of free bytes wanted
+/// @param data Set to the first free byte of the buffer
+/// @return Number of free bytes at data, which may be fewer than want; 0 on a write error
+size_t output_reserve( Output * out, size_t want, uchar ** data ){
+    if(out->error)
+        return 0;
+    if(OUTPUT_BUFSIZE - out->len < want && out->len > 0 && !drain(out, 0))
+        return 0;
+    *data = out->buf + out->len;
+    return OUTPUT_BUFSIZE - out->len;
+}
+
+/// Add bytes produced into reserved room to the output
+/// @param out Output to write to
+/// @param len Number of bytes produced, no more than were reserved
+void output_commit( Output * out, size_t len ){
+    out->len += len;
+}
+
+/// Write out every buffered byte
+/// @param out Output to flush
+/// @return 1 on success, 0 on a write error
+int output_flush( Output * out ){
+    if(out->full != NULL){
+        drain(out, 0);
+        stop_writer(out);
+    }
+    return !out->error && drain(out, 1);
+}
+
+/// Check whether the output can be written out of order, flushing it first
+/// @param out Output to check
+/// @return nonzero if output_write_at can be used
+int output_positional( Output * out ){
+    return out->seekable && !out->direct && output_flush(out);
+}
+
+/// Write bytes at an offset past the output's current end. Workers may
+/// write disjoint ranges at once; output_skip then moves past them.
+/// @param out Output for which output_positional returned nonzero
+/// @param data Bytes to write
+/// @param len Number of bytes in data
+/// @param offset Offset from the current end of the output
+/// @return 1 on success, 0 on a write error
+int output_write_at( Output * out, const uchar * data, size_t len, uint64_t offset ){
+    off_t position = out->base + out->written + offset;
+    while(len > 0){
+        ssize_t num_written = pwrite(out->fd, data, len, position);
+        if(num_written < 0 && errno == EINTR)
+            continue;
+        if(num_written <= 0)
+            return 0;
+        data += num_written;
+        len -= num_written;
+        position += num_written;
+    }
+    return 1;
+}
+
+/// Move the end of the output past bytes written with output_write_at
+/// @param out Output written in place
+/// @param len Number of bytes to move past
+/// @return 1 on success, 0 on a seek error
+int output_skip( Output * out, uint64_t len ){
+    if(lseek(out->fd, len, SEEK_CUR) < 0){
+        out->error = 1;
+        return 0;
+    }
+    out->written += len;
+    return 1;
+}
+
+/// Get the number of bytes written to the output, buffered bytes included
+/// @param out Output to measure
+/// @return Number of bytes
+uint64_t output_size( Output * out ){
+    return out->written + out->len;
+}
+
+/// Flush an output, close its file and free its buffer
+/// @param out Output to close
+/// @return 1 on success, 0 if a write or the close failed
+int output_close( Output * out ){
+    int ok = out->buf == NULL || output_flush(out);
+    if(out->owned && close(out->fd) != 0)
+        ok = 0;
+    for(int i = 0; i < OUTPUT_BUFFERS; i++){
+        free(out->chunks[i].data);
+        out->chunks[i].data = NULL;
+    }
+    out->buf = NULL;
+    out->owned = 0;
+    return ok;
+}
@@ -0,0 +1,132 @@
+//
+// file: output.h
+// description: Definition file for writing decoded output through large aligned buffers
+//
+// @author Daniel Tregea
+//
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "packman_utils.h"
+#include "ring.h"
+
+/// Number of bytes collected before they are written out
+#define OUTPUT_BUFSIZE  ( 1 << 20 )
+
+/// Number of buffers an output with a writer thread fills in turn
+#define OUTPUT_BUFFERS  4
+
+/// Output_chunk is one buffer of an output
+typedef struct Output_chunk_s {
+    uchar * data;       ///< OUTPUT_BUFSIZE aligned bytes, or NULL if not allocated
+    size_t len;         ///< number of bytes the writer thread is to write
+    int ok;             ///< zero once the writer thread failed to write the chunk
+} Output_chunk;
+
+/// Output collects bytes in a large page aligned buffer and writes them a
+/// buffer at a time. Files and stdout are written through their file
+/// descriptors with write and writev, so there is one system call per
+/// buffer rather than a library call per chunk, and regular files can
+/// also be written out of order with pwrite. Files may be opened with
+/// O_DIRECT to keep decoded output out of the page cache. Streams the
+/// library writes to memory are written with fwrite instead.
+/// With a writer thread, full buffers are handed to it through a ring and
+/// filling goes on in the next buffer, so decoding and writing overlap.
+typedef struct Output_s {
+    FILE * fp;          ///< stream written with fwrite, or NULL when writing fd
+    int fd;             ///< file descriptor written directly, or -1
+    int owned;          ///< nonzero if fd must be closed with the output
+    int direct;         ///< nonzero while fd is open with O_DIRECT
+    int seekable;       ///< nonzero if fd is a regular file that can be written out of order
+    Output_chunk chunks[OUTPUT_BUFFERS];  ///< buffers; only the first is used without a writer thread
+    Output_chunk * chunk;  ///< buffer being filled
+    uchar * buf;        ///< data of the buffer being filled
+    size_t len;         ///< number of bytes in buf
+    uint64_t base;      ///< file offset of fd when the output was opened
+    uint64_t written;   ///< number of bytes written, or handed to the writer thread, out of buf or in place
+    int error;          ///< nonzero once a write has failed
+    Ring full;          ///< buffers for the writer thread, or NULL when writing in place
+    Ring empty;         ///< buffers the writer thread has written
+    pthread_t writer;   ///< thread writing full buffers in order
+} Output;
+
+/// Open an output file for writing through its file descriptor
+/// @param out Output to initialize
+/// @param name Name of the file to create, "-" for stdout
+/// @param direct Nonzero to open a file with O_DIRECT where the file system allows it
+/// @return 1 on success, 0 if the file can't be created or on allocation failure
+int output_open( Output * out, const char * name, int direct );
+
+/// Write to a stream through an output's buffer
+/// @param out Output to initialize
+/// @param fp Stream to write to, still owned by the caller
+/// @return 1 on success, 0 on allocation failure
+int output_open_stream( Output * out, FILE * fp );
+
+/// Write the output's buffers on a writer thread from now until it is
+/// flushed. If the thread can't be started, writes happen in place.
+/// @param out Output opened with output_open
+void output_start_writer( Output * out );
+
+/// Copy bytes into the output, writing the buffer out as it fills.
+/// Large writes go straight from data, together with any buffered bytes.
+/// @param out Output to write to
+/// @param data Bytes to write
+/// @param len Number of bytes in data
+/// @return 1 on success, 0 on a write error
+int output_write( Output * out, const uchar * data, size_t len );
+
+/// Get room in the buffer to produce bytes into directly, writing the
+/// buffer out first if it holds fewer than want free bytes
+/// @param out Output to write to
+/// @param want Number of free bytes wanted
+/// @param data Set to the first free byte of the buffer
+/// @return Number of free bytes at data, which may be fewer than want; 0 on a write error
+size_t output_reserve( Output * out, size_t want, uchar ** data );
+
+/// Add bytes produced into reserved room to the output
+/// @param out Output to write to
+/// @param len Number of bytes produced, no more than were reserved
+void output_commit( Output * out, size_t len );
+
+/// Write out every buffered byte, and stop any writer thread once it has
+/// written everything handed to it
+/// @param out Output to flush
+/// @return 1 on success, 0 on a write error
+int output_flush( Output * out );
+
+/// Check whether the output can be written out of order, flushing it first
+/// @param out Output to check
+/// @return nonzero if output_write_at can be used
+int output_positional( Output * out );
+
+/// Write bytes at an offset past the output's current end. Workers may
+/// write disjoint ranges at once; output_skip then moves past them.
+/// @param out Output for which output_positional returned nonzero
+/// @param data Bytes to write
+/// @param len Number of bytes in data
+/// @param offset Offset from the current end of the output
+/// @return 1 on success, 0 on a write error
+int output_write_at( Output * out, const uchar * data, size_t len, uint64_t offset );
+
+/// Move the end of the output past bytes written with output_write_at
+/// @param out Output written in place
+/// @param len Number of bytes to move past
+/// @return 1 on success, 0 on a seek error
+int output_skip( Output * out, uint64_t len );
+
+/// Get the number of bytes written to the output, buffered bytes included
+/// @param out Output to measure
+/// @return Number of bytes
+uint64_t output_size( Output * out );
+
+/// Flush an output, close its file and free its buffer
+/// @param out Output to close
+/// @return 1 on success, 0 if a write or the close failed
+int output_close( Output * out );
+
+#endif
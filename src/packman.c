@@ -5,188 +5,191 @@
 // @author Daniel Tregea
 //
 
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "packman_utils.h"
-#include "encode.h"
-#include "decode.h"
 #include "utilities.h"
+#include "blocks.h"
+#include "dynamic.h"
+#include "libpackman.h"
 
-Tree_node huffman_tree; // Huffman tree read or written to files
-char * lut[256]; // Look up table generated from Huffman tree
-uint * encoded_binary; // Sequence of binary read or written to files
+/// Print the command line usage
+/// @return EXIT_FAILURE
+static int usage( void ){
+    fprintf(stderr, "usage: packman [-L max_code_length] [-b block_size[K|M]] [-a] [-i] [-4] [-j threads]"
+                    " [-r offset:length] [-p sample_size[K|M]] [-y] [-c] [-d] [-s | -S] firstfile secondfile\n");
+    return EXIT_FAILURE;
+}
 
-/// Main function to either encode files or decode packman encoded files
-/// @param argc Number of command line arguments
-/// @param argv Array of command line arguments containing input and output file
-/// @return EXIT_FAILURE on encode/decode failure, or EXIT_SUCCESS on encode/decode success
-int main( int argc, char * argv[] ){
+/// Names of the PACKMAN_PHASE_ phases
+static const char * phase_names[PACKMAN_NUM_PHASES] = { "read", "count", "build", "encode", "decode", "write" };
 
-    if(argc != 3){
-        fprintf(stderr, "usage: packman firstfile secondfile\n");
-        return EXIT_FAILURE;
-    }
+/// Print statistics as a human readable summary
+/// @param stats Statistics of the last encode or decode
+static void print_stats( const Packman_stats * stats ){
+    fprintf(stderr, "%-8s %10.6f s\n", "total", stats->total_seconds);
+    for(int phase = 0; phase < PACKMAN_NUM_PHASES; phase++)
+        if(stats->seconds[phase] > 0)
+            fprintf(stderr, "%-8s %10.6f s\n", phase_names[phase], stats->seconds[phase]);
+    fprintf(stderr, "bytes in %llu, bytes out %llu", (unsigned long long) stats->bytes_in,
+            (unsigned long long) stats->bytes_out);
+    if(stats->bytes_in > 0 && stats->bytes_out > 0)
+        fprintf(stderr, ", ratio %.4f", (double) stats->bytes_out / stats->bytes_in);
+    fprintf(stderr, "\nsymbols %llu, code bits %llu", (unsigned long long) stats->num_symbols,
+            (unsigned long long) stats->code_bits);
+    if(stats->num_symbols > 0)
+        fprintf(stderr, ", %.4f bits per symbol", (double) stats->code_bits / stats->num_symbols);
+    fprintf(stderr, "\nblocks %llu, code books %llu, longest code %u\n", (unsigned long long) stats->num_blocks,
+            (unsigned long long) stats->num_books, stats->longest_code);
+}
 
-    char * input_file = argv[1];
-    int encode;
-    FILE * fp;
-    
-    fp = fopen(input_file, "rb");
-    if (fp == NULL){
-        return handle_error(__FILE__, __LINE__, input_file, "NoSuchFile");
-    }
-    
-    // Determine whether to encode or decode depending on magic number
-    encode = find_packman_magic(fp);
-    if(encode < 0){
-        fclose(fp);
-        return handle_error(__FILE__, __LINE__, input_file, "File has no contents");
-    }
-    fclose(fp);
-        
-    if(encode){
-    
-        fp = fopen( input_file, "rb" );
-        if (fp == NULL)
-            return handle_error(__FILE__, __LINE__, input_file, "NoSuchFile");
-            
-        uint * frequencies =  calloc(256, sizeof(uint));
-        uchar data[1];
-        uint num_items = 0, num_unique = 0;
+/// Print statistics as one JSON object
+/// @param stats Statistics of the last encode or decode
+static void print_stats_json( const Packman_stats * stats ){
+    fprintf(stderr, "{\"total_seconds\":%.9f,\"seconds\":{", stats->total_seconds);
+    for(int phase = 0; phase < PACKMAN_NUM_PHASES; phase++)
+        fprintf(stderr, "%s\"%s\":%.9f", phase > 0 ? "," : "", phase_names[phase], stats->seconds[phase]);
+    fprintf(stderr, "},\"bytes_in\":%llu,\"bytes_out\":%llu,\"symbols\":%llu,\"code_bits\":%llu,"
+                    "\"blocks\":%llu,\"code_books\":%llu,\"longest_code\":%u}\n",
+            (unsigned long long) stats->bytes_in, (unsigned long long) stats->bytes_out,
+            (unsigned long long) stats->num_symbols, (unsigned long long) stats->code_bits,
+            (unsigned long long) stats->num_blocks, (unsigned long long) stats->num_books, stats->longest_code);
+}
 
-        // Read in symbol frequencies
-        while(fread(data, sizeof(uchar), 1, fp) > 0) {
-            num_items++;
-            frequencies[data[0]]++;
-            if(frequencies[data[0]] == 1)
-                num_unique++;
-        }
-        
-        fclose(fp);
-        
-        // Build frequency heap
-        Heap frequency_heap = hdt_create(num_unique, compare_node_min, print_node);
-        for(int i = 0; i < 256; i++){
-            if(frequencies[i] > 0){
-                Tree_node node = create_tree_node(i, frequencies[i], 0);
-                hdt_insert_item(frequency_heap,(void*) node);
-            }
-        }
-        
-        // Build huffman tree
-        huffman_tree = heap_to_huffman(frequency_heap);
-        
-        // Build look up table
-        populate_lut(lut, huffman_tree, "", "");
-        
-        fp = fopen(input_file, "r");
-        if (fp == NULL)
-            return handle_error(__FILE__, __LINE__, input_file, "NoSuchFile");
-        
-        // Read file and create sequence of bits to write to output file
-        uint * bits;
-        uint num_bits = 0;
-        while(fread(data, sizeof(uchar), 1, fp) > 0){ // Iterate one character at a time
-            char * code = lut[data[0]]; // get character code from look up table
-            uchar code_length = strlen(code); // get length of code
-            
-            if(num_bits > 0) // increase size of array to fit in new code
-                bits = realloc(bits, (code_length + num_bits) * sizeof(uint));
-            else
-                bits = malloc(code_length * sizeof(uint));
-                
-            for(uint i = num_bits, j = 0; i < num_bits + code_length; i++, j++) // append each digit of code to the array
-                bits[i] = (code[j] == '0' ? 0 : 1);
-            
-            num_bits += code_length; // length of code is added onto number of bits
-        }
-        
-        fclose(fp);
-        
-        // Pack character array of code bits into unsigned integers
-        uint num_uint = bits_to_num_uint(num_bits);
-        encoded_binary = pack_bits(bits, num_bits, num_uint);
+/// Parse a byte count with an optional K, M or G suffix
+/// @param arg Command line argument to parse
+/// @param end Set to the first character after the byte count
+/// @return Number of bytes
+static uint64_t parse_bytes( const char * arg, char ** end ){
+    uint64_t bytes = strtoull(arg, end, 10);
+    if(**end == 'K' || **end == 'k'){
+        bytes <<= 10;
+        (*end)++;
+    } else if(**end == 'M' || **end == 'm'){
+        bytes <<= 20;
+        (*end)++;
+    } else if(**end == 'G' || **end == 'g'){
+        bytes <<= 30;
+        (*end)++;
+    }
+    return bytes;
+}
 
-        fp = get_output_stream(argv);
-        
-        if (fp == NULL)
-            return handle_error(__FILE__, __LINE__, input_file, "Can't Write to File");
-        
-        // write magic number, huffman tree decoding, and binary symbol codes
-        write_magic(fp);
-        write_tree(fp, huffman_tree);
-        uint * num_bits_array = malloc(sizeof(uint)); // fwrite needs pointer to integer
-        num_bits_array[0] = num_bits;
-        fwrite(num_bits_array, sizeof(uint), 1, fp);
-        fwrite(encoded_binary, sizeof(uint), num_uint, fp);
-        
-        // free everything
-        hdt_destroy(frequency_heap);
-        free(frequencies);
-        free(bits);
-        free(num_bits_array);
+/// Parse a block size with an optional K or M suffix
+/// @param arg Command line argument to parse
+/// @return Number of bytes, or 0 if arg is not a valid size
+static size_t parse_size( const char * arg ){
+    char * end;
+    uint64_t size = parse_bytes(arg, &end);
+    return *end == NUL && size <= MAX_BLOCK_SIZE ? (size_t) size : 0;
+}
 
-        
-    } else { // Decode
-        
-        fp = fopen( input_file, "rb" );
-        if (fp == NULL)
-            return handle_error(__FILE__, __LINE__, input_file, "NoSuchFile");
+/// Parse a byte range written as offset:length
+/// @param arg Command line argument to parse
+/// @param options Options to store the range in
+/// @return 1 on success, 0 if arg is not a valid range
+static int parse_range( const char * arg, Packman_options * options ){
+    char * end;
+    options->range_offset = parse_bytes(arg, &end);
+    if(end == arg || *end != ':')
+        return 0;
+    arg = end + 1;
+    options->range_length = parse_bytes(arg, &end);
+    options->ranged = 1;
+    return end != arg && *end == NUL;
+}
 
-        // Read huffman tree
-        find_packman_magic(fp);
-        huffman_tree = read_tree(fp);
-        if(huffman_tree == NULL){
-            fclose(fp);
-            return handle_error(__FILE__, __LINE__, input_file, "Binary Tree Not Found");
-        }
-        // Read number of bits
-        uint num_bits_array[1];
-        if(fread(num_bits_array, sizeof(uint), 1, fp) == 0){
-            free_tree(huffman_tree);
-            fclose(fp);
-            return handle_error(__FILE__, __LINE__, input_file, "No data found after binary tree");
-        }
-        
-        // Generate look up table
-        uint num_bits = num_bits_array[0];
-        populate_lut(lut, huffman_tree, "", "");
+/// Main function to either encode files or decode packman encoded files
+/// @param argc Number of command line arguments
+/// @param argv Array of command line arguments containing options, input and output file
+/// @return EXIT_FAILURE on encode/decode failure, or EXIT_SUCCESS on encode/decode success
+int main( int argc, char * argv[] ){
 
-        // Get number of unsigned integers needed to hold all the symbol code bits
-        uint num_uint = bits_to_num_uint(num_bits);
-        
-        encoded_binary = calloc(num_uint, sizeof(uint));
-        
-        // Read in the symbol code bits
-        fread(encoded_binary, sizeof(uint), num_uint, fp);
-        fclose(fp);
-        
-        // Get each bit from the unsigned integers read and put into a char array
-        char ** bits = uint_to_str_bits(num_bits, encoded_binary);
-        
-        // Determine output stream
-        fp = get_output_stream(argv);
-        
-        if (fp == NULL){
-            free(bits);
-            free(encoded_binary);
-            free_tree(huffman_tree);
-            return handle_error(__FILE__, __LINE__, input_file, "Can't Write to File");
+    Packman_options options;
+    packman_default_options(&options);
+    int opt, stats_format = 0;
+    while((opt = getopt(argc, argv, "L:b:ai4j:r:p:ycdsS")) != -1){
+        switch(opt){
+        case 'L':
+            options.max_length = strtoul(optarg, NULL, 10);
+            if(options.max_length < 1 || options.max_length > MAX_CODE_LENGTH)
+                return usage();
+            break;
+        case 'b':
+            options.block_size = parse_size(optarg);
+            if(options.block_size == 0)
+                return usage();
+            break;
+        case 'a':
+            options.adaptive = 1;
+            break;
+        case 'i':
+            options.indexed = 1;
+            break;
+        case '4':
+            options.interleaved = 1;
+            break;
+        case 'j':
+            options.num_threads = atoi(optarg);
+            if(options.num_threads < 1)
+                return usage();
+            break;
+        case 'r':
+            if(!parse_range(optarg, &options))
+                return usage();
+            break;
+        case 'p':
+            options.sample_size = parse_size(optarg);
+            if(options.sample_size == 0)
+                return usage();
+            break;
+        case 'y':
+            options.dynamic = 1;
+            break;
+        case 'c':
+            options.context = 1;
+            break;
+        case 'd':
+            options.direct = 1;
+            break;
+        case 's':
+        case 'S':
+            options.collect_stats = 1;
+            stats_format = opt;
+            break;
+        default:
+            return usage();
         }
-        
-        // Decode bits and write to output stream
-        if(!write_bits(bits, num_bits, lut, fp))
-            return handle_error(__FILE__, __LINE__, input_file, "Realloc failure");
-        
-        free(bits);
     }
-    
-    // Free all memory
-    fclose(fp);
-    free(encoded_binary);
-    free_tree(huffman_tree);
-    free_lut(lut);
+    if(argc - optind != 2)
+        return usage();
+
+    // Dynamic and context files are one stream, with no blocks or index
+    int blocks = options.block_size > 0 || options.indexed || options.interleaved || options.adaptive
+              || options.sample_size > 0;
+    if(options.dynamic && (blocks || options.context
+                           || (options.max_length > 0 && options.max_length < DYNAMIC_MIN_LENGTH)))
+        return usage();
+    if(options.context && blocks)
+        return usage();
+
+    char * input_file = argv[optind];
+    char * output_file = argv[optind + 1];
+    Packman ctx = packman_create(&options);
+    if(ctx == NULL)
+        return handle_error(__FILE__, __LINE__, input_file, "Malloc failure");
 
-    return EXIT_SUCCESS;
+    // Decode packman files and encode everything else
+    int status = EXIT_SUCCESS;
+    if(!packman_process_file(ctx, input_file, output_file))
+        status = handle_error(__FILE__, __LINE__, input_file, (char *) packman_error(ctx));
+    else if(stats_format == 's')
+        print_stats(packman_stats(ctx));
+    else if(stats_format == 'S')
+        print_stats_json(packman_stats(ctx));
+    packman_destroy(ctx);
+    return status;
 }
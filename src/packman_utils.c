@@ -11,14 +11,23 @@
 #include "packman_utils.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <inttypes.h>
+
+/// Release every node of an arena for reuse
+/// @param arena Arena to reset
+void arena_reset( Node_arena * arena ){
+  arena->num_nodes = 0;
+}
 
 /// Create a TreeNode from a given symbol and frequency
+/// @param arena Arena to take the node from
 /// @param symbol Symbol to be stored in the node
 /// @param frequency Frequency of the symbol
-/// @return TreeNode containing the symbol and frequency
-Tree_node create_tree_node( uchar sym, int freq, int internal){
-  Tree_node new_node = NULL;
-  new_node = malloc(sizeof( struct Tree_node_s));
+/// @return TreeNode containing the symbol and frequency, or NULL if the arena is full
+Tree_node create_tree_node( Node_arena * arena, uchar sym, uint64_t freq, int internal){
+  if(arena->num_nodes == MAX_TREE_NODES)
+    return NULL;
+  Tree_node new_node = &arena->nodes[arena->num_nodes++];
   new_node->sym = sym;
   new_node->freq = freq;
   new_node->internal = internal;
@@ -27,27 +36,28 @@ Tree_node create_tree_node( uchar sym, int freq, int internal){
   return new_node;
 }
 
-/// Free a TreeNode and all of its children
-/// @param node Head of TreeNode to be freed
-void free_tree(Tree_node node){
-  if(node == NULL){
-    return;
-  }
-  free_tree(node->left);
-  free_tree(node->right);
-  free(node);
-}
-
 /// Write the packman magic number to a file indicating it is encoded by this program
 /// @param fp Output stream to write to
 int write_magic( FILE * ofp){
   unsigned short * magic_num_array = malloc(sizeof(unsigned short));
-  magic_num_array[0] = 0x80F0;
+  magic_num_array[0] = PACKMAN_MAGIC;
   fwrite(magic_num_array, sizeof(unsigned short), 1, ofp);
   free(magic_num_array);
   return 1;
 }
 
+/// Write the versioned container magic number and the format of the file
+/// @param ofp Output stream to write to
+/// @param format Format of the rest of the file
+/// @return 1 on success, 0 on write failure
+int write_container_header( FILE * ofp, uchar format ){
+  ushort magic[1] = { PACKMAN_MAGIC_V2 };
+  uchar format_array[1] = { format };
+  if(fwrite(magic, sizeof(ushort), 1, ofp) != 1)
+    return 0;
+  return fwrite(format_array, sizeof(uchar), 1, ofp) == 1;
+}
+
 /// Write a binary tree to a file
 /// @param tree Tree to be written to file
 /// @param fp Output stream to write to
@@ -71,22 +81,29 @@ int write_tree( FILE * ofp, Tree_node node){
 
 /// Read a binary tree from a file
 /// @param fp Input stream to read from
-/// @return TreeNode containing the tree read from file
-Tree_node read_tree( FILE * fp ){
+/// @param arena Arena to take the nodes from
+/// @return TreeNode containing the tree read from file, or NULL on a malformed tree
+Tree_node read_tree( FILE * fp, Node_arena * arena ){
   long int pos;
   pos = ftell(fp);
   uchar byte_read[1];
-  fread(byte_read, sizeof(uchar), 1, fp);
+  if(fread(byte_read, sizeof(uchar), 1, fp) != 1)
+    return NULL;
   Tree_node new_node;
   if(byte_read[0] == 0){ // Internal node read
-    new_node = create_tree_node(0,0, 1);
-    new_node->left = read_tree(fp);
-    new_node->right = read_tree(fp);
+    new_node = create_tree_node(arena, 0, 0, 1);
+    if(new_node == NULL)
+      return NULL;
+    new_node->left = read_tree(fp, arena);
+    new_node->right = new_node->left == NULL ? NULL : read_tree(fp, arena);
+    if(new_node->right == NULL) // an interior node always has two children
+      return NULL;
   } else if(byte_read[0] == 0x01){ // Leaf node read
     
     uchar leaf[1];
-    fread(leaf, sizeof(uchar), 1, fp);
-    new_node = create_tree_node(leaf[0],0, 0);
+    if(fread(leaf, sizeof(uchar), 1, fp) != 1)
+      return NULL;
+    new_node = create_tree_node(arena, leaf[0], 0, 0);
   } else {
     fseek (fp, pos, SEEK_SET);
     new_node = NULL;
@@ -108,7 +125,7 @@ void report_error( char * codefile, int line, char * fname, char * msg ){
 /// @param node Head of TreeNode to be printed
 void print_tree( Tree_node tree ){
 if(tree == NULL) return;
-  printf("[%c, %d]-", tree->sym, tree->freq);
+  printf("[%c, %" PRIu64 "]-", tree->sym, tree->freq);
   print_tree(tree->left);
   print_tree(tree->right);
 }
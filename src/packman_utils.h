@@ -53,6 +53,35 @@ typedef uint32_t uint;
 
 #define MAX_BIT_INDEX  ( BITS_IN_INT - 1 )
 
+/// MAX_CODE_LENGTH is the longest symbol code packman encodes or decodes
+
+#define MAX_CODE_LENGTH  64
+
+/// PACKMAN_MAGIC begins every packman file written in the original tree format.
+
+#define PACKMAN_MAGIC  0x80F0
+
+/// PACKMAN_MAGIC_V2 begins every packman file written in a versioned
+/// container. The magic is followed by a format byte naming the layout
+/// of the rest of the file.
+
+#define PACKMAN_MAGIC_V2  0x80F1
+
+/// Formats of the versioned container
+
+enum {
+    FORMAT_CANONICAL = 1,  ///< code lengths, 64 bit num_bits, one code stream
+    FORMAT_BLOCKS,         ///< block size, then independently coded blocks
+    FORMAT_INDEXED,        ///< code lengths, one code stream, then a block index
+    FORMAT_DYNAMIC,        ///< longest code length, then segments coded with a code book rebuilt after each
+    FORMAT_CONTEXT         ///< book count, book of each previous byte, code lengths, counts, one code stream
+};
+
+/// NUM_STREAMS is the number of code streams an interleaved block is split
+/// into. Symbol i of the block is coded in stream i % NUM_STREAMS.
+
+#define NUM_STREAMS  4
+
 // === magic function
 
 /// get_magic returns the 'magic number' for binary packman files.
@@ -66,7 +95,7 @@ typedef uint32_t uint;
 /// Tree_node_s structure stores sym, the symbol name, and its frequency.
 
 struct Tree_node_s {
-    int freq;                 ///< frequency
+    uint64_t freq;            ///< frequency
     uchar sym;                ///< symbol is NUL if node is an interior node
     struct Tree_node_s * left;  ///< left child
     struct Tree_node_s * right; ///< right child
@@ -76,24 +105,50 @@ struct Tree_node_s {
 /// Tree_node is a pointer to a Tree_node structure.
 typedef struct Tree_node_s * Tree_node;
 
-/// create_tree_node allocates space for a Tree_node and stores the
+/// MAX_TREE_NODES is the most nodes a huffman tree over 256 symbols has
+
+#define MAX_TREE_NODES  ( 2 * 256 - 1 )
+
+/// Node_arena_s holds the nodes of one huffman tree. Nodes are handed out
+/// in order and released together by resetting the arena, so building
+/// and tearing down a tree allocates nothing.
+
+typedef struct Node_arena_s {
+    struct Tree_node_s nodes[MAX_TREE_NODES];  ///< node storage
+    uint num_nodes;                            ///< number of nodes handed out
+} Node_arena;
+
+/// arena_reset releases every node of an arena for reuse.
+/// @param arena the arena to reset
+
+void arena_reset( Node_arena * arena ) ;
+
+/// create_tree_node takes a Tree_node from an arena and stores the
 /// symbol and its frequency.
+/// @param arena the arena to take the node from
 /// @param sym the unsigned character symbol
 /// @param freq the frequency of the symbol's occurrence
-/// @return pointer to Tree_node allocated on the heap or NULL on failure
-
-Tree_node create_tree_node( uchar sym, int freq, int internal) ;
+/// @param internal 1 for an interior node, 0 for a leaf
+/// @return pointer to Tree_node in the arena or NULL if the arena is full
 
-/// free_tree deallocates the node.
-/// @param node a pointer to the dynamic storage for the node node.
-/// @pre node must be a pointer to dynamic storage.
-
-void free_tree(Tree_node node) ;
+Tree_node create_tree_node( Node_arena * arena, uchar sym, uint64_t freq, int internal) ;
 
 // === 'tree file' functions
 
+/// write_magic writes the magic number of the original tree format.
+/// @param ofp the open file pointer to which to write
+/// @return 1
+
 int write_magic( FILE * ofp);
 
+/// write_container_header writes the magic number of the versioned
+/// container followed by the format of the file.
+/// @param ofp the open file pointer to which to write
+/// @param format one of the FORMAT_ values
+/// @return 1 on success and 0 on error
+
+int write_container_header( FILE * ofp, uchar format ) ;
+
 /// write_tree writes an encoded version of node to the output file pointer.
 /// The encoded version of node inside is called a 'node file' object.
 /// @param ofp the open file pointer to which to write
@@ -109,10 +164,11 @@ void print_tree( Tree_node tree ) ;
 
 /// read_tree reads an encoded 'tree file' object from the input file pointer.
 /// @param fp the open file pointer from which to read.
-/// @return Tree_node, a dynamic pointer to the tree, or NULL on failure.
-/// @post Tree_node memory is owned by the caller.
+/// @param arena the arena the nodes of the tree are taken from.
+/// @return Tree_node, a pointer to the tree, or NULL on failure.
+/// @post Tree_node memory is owned by the arena.
 
-Tree_node read_tree( FILE * fp ) ;
+Tree_node read_tree( FILE * fp, Node_arena * arena ) ;
 
 /// report_error is a general purpose error print routine.
 /// <br>
@@ -0,0 +1,87 @@
+//
+// file: ring.c
+// description: Implementation file for a bounded ring passing items between two threads
+//
+// @author Daniel Tregea
+//
+
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <semaphore.h>
+#include "ring.h"
+
+/// Definition of ring_s. The semaphores count the filled and free slots;
+/// posting one publishes the slot it covers to the other side, so the
+/// indices need no lock.
+struct ring_s {
+    void ** items;       ///< circular array of items
+    size_t capacity;     ///< number of slots in items
+    size_t head;         ///< next slot to pop, touched only by the consumer
+    size_t tail;         ///< next slot to push, touched only by the producer
+    sem_t filled;        ///< number of items waiting to be popped
+    sem_t empty;         ///< number of empty slots
+};
+
+/// ring_create makes an empty ring
+/// @param capacity Largest number of items the ring holds
+/// @return a Ring instance, or NULL on allocation failure
+Ring ring_create( size_t capacity ){
+    Ring ring = calloc(1, sizeof(struct ring_s));
+    if(ring == NULL)
+        return NULL;
+    ring->items = malloc(capacity * sizeof(void *));
+    ring->capacity = capacity;
+    if(ring->items == NULL || sem_init(&ring->filled, 0, 0) != 0){
+        free(ring->items);
+        free(ring);
+        return NULL;
+    }
+    if(sem_init(&ring->empty, 0, capacity) != 0){
+        sem_destroy(&ring->filled);
+        free(ring->items);
+        free(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+/// Wait for a semaphore, retrying when a signal interrupts the wait
+/// @param sem Semaphore to wait for
+static void wait_for( sem_t * sem ){
+    while(sem_wait(sem) != 0 && errno == EINTR)
+        ;
+}
+
+/// ring_push adds an item, waiting while the ring is full.
+/// Only the producer thread may push.
+/// @param ring The subject Ring
+/// @param item Item to add
+void ring_push( Ring ring, void * item ){
+    wait_for(&ring->empty);
+    ring->items[ring->tail] = item;
+    ring->tail = (ring->tail + 1) % ring->capacity;
+    sem_post(&ring->filled);
+}
+
+/// ring_pop removes the oldest item, waiting while the ring is empty.
+/// Only the consumer thread may pop.
+/// @param ring The subject Ring
+/// @return The oldest item
+void * ring_pop( Ring ring ){
+    wait_for(&ring->filled);
+    void * item = ring->items[ring->head];
+    ring->head = (ring->head + 1) % ring->capacity;
+    sem_post(&ring->empty);
+    return item;
+}
+
+/// ring_destroy frees a ring
+/// @param ring The subject Ring
+/// @post the ring reference is no longer valid.
+void ring_destroy( Ring ring ){
+    sem_destroy(&ring->filled);
+    sem_destroy(&ring->empty);
+    free(ring->items);
+    free(ring);
+}
@@ -0,0 +1,43 @@
+//
+// file: ring.h
+// description: Definition file for a bounded ring passing items between two threads
+//
+// @author Daniel Tregea
+//
+
+#ifndef RING_H
+#define RING_H
+#include <stddef.h>
+
+/// The Ring type name is a pointer to a type that is opaque to clients.
+/// A ring carries pointers from one producer thread to one consumer
+/// thread in order. Neither side takes a lock: each owns its end of the
+/// ring, and a side only sleeps when the ring is full or empty.
+/// Pipeline stages pass fixed size chunks through a pair of rings, one
+/// carrying filled chunks forward and one returning them for reuse, so
+/// a fast stage runs at most a ring's capacity ahead of a slow one.
+typedef struct ring_s * Ring;
+
+/// ring_create makes an empty ring
+/// @param capacity Largest number of items the ring holds
+/// @return a Ring instance, or NULL on allocation failure
+Ring ring_create( size_t capacity );
+
+/// ring_push adds an item, waiting while the ring is full.
+/// Only the producer thread may push.
+/// @param ring The subject Ring
+/// @param item Item to add
+void ring_push( Ring ring, void * item );
+
+/// ring_pop removes the oldest item, waiting while the ring is empty.
+/// Only the consumer thread may pop.
+/// @param ring The subject Ring
+/// @return The oldest item
+void * ring_pop( Ring ring );
+
+/// ring_destroy frees a ring
+/// @param ring The subject Ring
+/// @post the ring reference is no longer valid.
+void ring_destroy( Ring ring );
+
+#endif
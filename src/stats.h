@@ -0,0 +1,37 @@
+//
+// file: stats.h
+// description: Definition file for timing the phases of an encode or decode
+//
+// @author Daniel Tregea
+//
+
+#ifndef STATS_H
+#define STATS_H
+#include <time.h>
+#include "libpackman.h"
+
+/// Read the monotonic clock. Files using it define _DEFAULT_SOURCE.
+/// @return Current time in seconds
+static inline double stats_clock( void ){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/// Start timing a phase. Nothing is read when statistics are off.
+/// @param stats Statistics being collected, or NULL
+/// @return Start time of the phase
+static inline double stats_start( const Packman_stats * stats ){
+    return stats != NULL ? stats_clock() : 0;
+}
+
+/// Add the time since a phase started to its total
+/// @param stats Statistics being collected, or NULL
+/// @param phase PACKMAN_PHASE_ of the phase
+/// @param start Start time returned by stats_start
+static inline void stats_stop( Packman_stats * stats, int phase, double start ){
+    if(stats != NULL)
+        stats->seconds[phase] += stats_clock() - start;
+}
+
+#endif
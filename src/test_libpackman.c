@@ -0,0 +1,251 @@
+//
+// file: test_libpackman.c
+// description: Tests of the libpackman buffer and streaming API, run by make check
+//
+// @author Daniel Tregea
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libpackman.h"
+
+/// Number of bytes in each generated test buffer
+#define TEST_LEN  ( 50 << 10 )
+
+/// Block size of the block mode files the tests write
+#define TEST_BLOCK_SIZE  4096
+
+/// Number of checks run and failed
+static int checks = 0, failures = 0;
+
+/// Record the result of one check
+/// @param passed Nonzero if the check passed
+/// @param what Description printed if the check failed
+/// @param ctx Context whose error is printed with a failure, or NULL
+static void check( int passed, const char * what, Packman ctx ){
+    checks++;
+    if(!passed){
+        failures++;
+        const char * error = ctx != NULL ? packman_error(ctx) : NULL;
+        fprintf(stderr, "FAIL: %s%s%s\n", what, error != NULL ? ": " : "", error != NULL ? error : "");
+    }
+}
+
+/// Fill a buffer with one of the test distributions
+/// @param kind Distribution number, 0 to 3
+/// @param data Buffer of TEST_LEN bytes to fill
+/// @return Name of the distribution
+static const char * fill_data( int kind, unsigned char * data ){
+    unsigned int seed = 12345;
+    for(size_t i = 0; i < TEST_LEN; i++){
+        seed = seed * 1103515245 + 12345;
+        unsigned int r = seed >> 16;
+        switch(kind){
+        case 0: // lines of a small alphabet, like text
+            data[i] = i % 61 == 60 ? '\n' : (unsigned char)('a' + r % 7 * r % 13);
+            break;
+        case 1: // skewed towards the low byte values
+            data[i] = (unsigned char)(r % 2 ? r % 4 : r % 256 * (r % 3 == 0));
+            break;
+        case 2: // every byte equally likely
+            data[i] = (unsigned char) r;
+            break;
+        default: // one symbol
+            data[i] = 'z';
+        }
+    }
+    static const char * names[] = { "text", "skewed", "random", "single" };
+    return names[kind];
+}
+
+/// Pull all the output a stream has ready, appending it to a growing buffer
+/// @param ctx The subject Packman
+/// @param out Buffer to append to, reallocated as it fills
+/// @param len Number of bytes in out, updated
+/// @param capacity Number of bytes out can hold, updated
+/// @return 1 on success, 0 on allocation failure
+static int pull_all( Packman ctx, unsigned char ** out, size_t * len, size_t * capacity ){
+    for(;;){
+        if(*capacity - *len < 1000){
+            unsigned char * grown = realloc(*out, *capacity * 2);
+            if(grown == NULL)
+                return 0;
+            *out = grown;
+            *capacity *= 2;
+        }
+        size_t pulled = packman_pull(ctx, *out + *len, 1000);
+        if(pulled == 0)
+            return 1;
+        *len += pulled;
+    }
+}
+
+/// Run a whole stream through a context, pushing its input in chunks and
+/// pulling the output after every push
+/// @param ctx The subject Packman
+/// @param encode Nonzero to encode, 0 to decode
+/// @param src Bytes to push
+/// @param len Number of bytes in src
+/// @param chunk Number of bytes to push at a time
+/// @param dst Set to the output, to be released with free
+/// @param dst_len Set to the number of output bytes
+/// @return 1 on success, 0 on failure
+static int run_stream( Packman ctx, int encode, const unsigned char * src, size_t len, size_t chunk,
+                       unsigned char ** dst, size_t * dst_len ){
+    size_t capacity = 4096;
+    *dst = malloc(capacity);
+    *dst_len = 0;
+    int ok = *dst != NULL && (encode ? packman_begin_encode(ctx) : packman_begin_decode(ctx));
+    for(size_t pos = 0; ok && pos < len; pos += chunk)
+        ok = packman_push(ctx, src + pos, len - pos < chunk ? len - pos : chunk)
+          && pull_all(ctx, dst, dst_len, &capacity);
+    ok = ok && packman_finish(ctx) && pull_all(ctx, dst, dst_len, &capacity);
+    if(!ok){
+        free(*dst);
+        *dst = NULL;
+    }
+    return ok;
+}
+
+/// Check that a decoded buffer matches the original
+/// @param decoded Decoded bytes, freed here
+/// @param decoded_len Number of decoded bytes
+/// @param original Original bytes
+/// @return 1 if they match, 0 otherwise
+static int same_bytes( unsigned char * decoded, size_t decoded_len, const unsigned char * original ){
+    int same = decoded_len == TEST_LEN && memcmp(decoded, original, TEST_LEN) == 0;
+    free(decoded);
+    return same;
+}
+
+/// Find the number of symbols of the first block of a block mode file:
+/// after the file header come the block's flags and its code lengths
+/// @param image Block mode file image
+/// @return Offset of the first block's symbol count
+static size_t first_block_count( const unsigned char * image ){
+    size_t lengths = 2 + 1 + 4 + 1;  // magic, format, block size, flags
+    unsigned char first = image[lengths], last = image[lengths + 1], longest = image[lengths + 2];
+    size_t packed = longest < 16 ? (size_t)(last - first) / 2 + 1 : (size_t)(last - first) + 1;
+    return lengths + 3 + packed;
+}
+
+/// Check buffer and streaming round trips of one set of options
+/// @param options Options to encode with
+/// @param mode Name of the options for failures
+/// @param data Bytes to encode
+/// @param name Name of data for failures
+static void test_options( const Packman_options * options, const char * mode, const unsigned char * data,
+                          const char * name ){
+    char what[256];
+    Packman ctx = packman_create(options);
+    unsigned char * encoded = NULL, * decoded;
+    size_t encoded_len, decoded_len;
+    snprintf(what, sizeof(what), "buffer round trip of %s [%s]", name, mode);
+    int encoded_ok = packman_encode_buffer(ctx, data, TEST_LEN, &encoded, &encoded_len);
+    check(encoded_ok && packman_decode_buffer(ctx, encoded, encoded_len, &decoded, &decoded_len)
+          && same_bytes(decoded, decoded_len, data), what, ctx);
+
+    // Pushes of one byte split every block header; the others split them at various places
+    static const size_t chunks[] = { 1, 7, 64, 1000, 4093, TEST_LEN * 2 };
+    for(size_t i = 0; encoded_ok && i < sizeof(chunks) / sizeof(chunks[0]); i++){
+        snprintf(what, sizeof(what), "pushed decode of %s [%s] in %zu byte chunks", name, mode, chunks[i]);
+        check(run_stream(ctx, 0, encoded, encoded_len, chunks[i], &decoded, &decoded_len)
+              && same_bytes(decoded, decoded_len, data), what, ctx);
+    }
+    free(encoded);
+    packman_destroy(ctx);
+}
+
+/// Check pushed encodes, which are always in block mode
+/// @param data Bytes to encode
+/// @param name Name of data for failures
+static void test_pushed_encode( const unsigned char * data, const char * name ){
+    char what[256];
+    Packman_options options;
+    packman_default_options(&options);
+    options.block_size = TEST_BLOCK_SIZE;
+    Packman ctx = packman_create(&options);
+    static const size_t chunks[] = { 1, 999, 4096, TEST_LEN };
+    for(size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++){
+        unsigned char * encoded, * decoded;
+        size_t encoded_len, decoded_len;
+        snprintf(what, sizeof(what), "pushed encode of %s in %zu byte chunks", name, chunks[i]);
+        int ok = run_stream(ctx, 1, data, TEST_LEN, chunks[i], &encoded, &encoded_len);
+        check(ok && packman_decode_buffer(ctx, encoded, encoded_len, &decoded, &decoded_len)
+              && same_bytes(decoded, decoded_len, data), what, ctx);
+        if(ok)
+            free(encoded);
+    }
+    packman_destroy(ctx);
+}
+
+/// Check that damaged input is reported as a failure
+/// @param data Bytes to encode
+static void test_failures( const unsigned char * data ){
+    Packman_options options;
+    packman_default_options(&options);
+    options.block_size = TEST_BLOCK_SIZE;
+    Packman ctx = packman_create(&options);
+    unsigned char * encoded, * decoded;
+    size_t encoded_len, decoded_len;
+    check(!packman_encode_buffer(ctx, NULL, 0, &encoded, &encoded_len) && packman_error(ctx) != NULL,
+          "encode of an empty buffer was accepted", NULL);
+    check(!packman_decode_buffer(ctx, data, TEST_LEN, &decoded, &decoded_len),
+          "decode of a buffer that isn't a packman file was accepted", NULL);
+    if(!packman_encode_buffer(ctx, data, TEST_LEN, &encoded, &encoded_len)){
+        check(0, "encode for the failure checks", ctx);
+        packman_destroy(ctx);
+        return;
+    }
+
+    // Every cut of a block mode file fails, from a buffer or pushed
+    static const size_t cuts[] = { 1, 4, 100, 3000 };
+    for(size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); i++){
+        check(!packman_decode_buffer(ctx, encoded, encoded_len - cuts[i], &decoded, &decoded_len),
+              "decode of a truncated buffer was accepted", NULL);
+        check(!run_stream(ctx, 0, encoded, encoded_len - cuts[i], 512, &decoded, &decoded_len),
+              "pushed decode of a truncated file was accepted", NULL);
+    }
+
+    // A block claiming more symbols than a block holds fails as soon as its
+    // header arrives, rather than waiting for code words that never come
+    unsigned int too_many = TEST_BLOCK_SIZE + 1;
+    memcpy(encoded + first_block_count(encoded), &too_many, sizeof(unsigned int));
+    check(packman_begin_decode(ctx) && !packman_push(ctx, encoded, first_block_count(encoded) + 64),
+          "pushed block header with too many symbols was accepted", NULL);
+    free(encoded);
+    packman_destroy(ctx);
+}
+
+/// Run the libpackman tests
+/// @return EXIT_SUCCESS if every check passed, EXIT_FAILURE otherwise
+int main( void ){
+    unsigned char * data = malloc(TEST_LEN);
+    if(data == NULL)
+        return EXIT_FAILURE;
+    for(int kind = 0; kind < 4; kind++){
+        const char * name = fill_data(kind, data);
+        Packman_options options;
+        for(int mode = 0; mode < 8; mode++){
+            static const char * modes[] = { "canonical", "-L 9", "-b 4K", "-i -b 4K", "-b 4K -4", "-a", "-y", "-c" };
+            packman_default_options(&options);
+            switch(mode){
+            case 1: options.max_length = 9; break;
+            case 2: options.block_size = TEST_BLOCK_SIZE; break;
+            case 3: options.indexed = 1; options.block_size = TEST_BLOCK_SIZE; break;
+            case 4: options.block_size = TEST_BLOCK_SIZE; options.interleaved = 1; break;
+            case 5: options.adaptive = 1; break;
+            case 6: options.dynamic = 1; break;
+            case 7: options.context = 1; break;
+            }
+            test_options(&options, modes[mode], data, name);
+        }
+        test_pushed_encode(data, name);
+    }
+    fill_data(0, data);
+    test_failures(data);
+    free(data);
+    printf("%d of %d libpackman checks passed\n", checks - failures, checks);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
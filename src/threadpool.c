@@ -0,0 +1,160 @@
+//
+// file: threadpool.c
+// description: Implementation file for a fixed size pool of worker threads
+//
+// @author Daniel Tregea
+//
+
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "threadpool.h"
+
+/// Task is one queued call of a function on a worker thread
+typedef struct Task_s {
+    void (*run)( void * arg );  ///< function to run
+    void * arg;                 ///< argument passed to run
+} Task;
+
+/// Definition of thread_pool_s
+struct thread_pool_s {
+    pthread_t * threads;         ///< worker threads
+    int num_threads;             ///< number of worker threads
+    Task * tasks;                ///< circular queue of waiting tasks
+    size_t capacity;             ///< number of tasks the queue can hold
+    size_t head;                 ///< index of the next task to run
+    size_t num_queued;           ///< number of tasks waiting in the queue
+    size_t num_pending;          ///< number of tasks queued or running
+    int shutdown;                ///< nonzero once the workers should exit
+    pthread_mutex_t lock;        ///< guards every field above
+    pthread_cond_t work_ready;   ///< signalled when a task is queued
+    pthread_cond_t work_done;    ///< signalled when the pool becomes idle
+};
+
+/// Run queued tasks until the pool shuts down
+/// @param arg The Thread_pool the worker belongs to
+/// @return NULL
+static void * worker( void * arg ){
+    Thread_pool pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    for(;;){
+        while(pool->num_queued == 0 && !pool->shutdown)
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        if(pool->num_queued == 0) // shut down with nothing left to do
+            break;
+        Task task = pool->tasks[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->num_queued--;
+        pthread_mutex_unlock(&pool->lock);
+
+        task.run(task.arg);
+
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->num_pending == 0)
+            pthread_cond_broadcast(&pool->work_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/// Determine the number of worker threads to use when none is requested
+/// @return Number of online processors, at least 1
+int tp_default_threads( void ){
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return num_cpus > 0 ? (int) num_cpus : 1;
+}
+
+/// tp_create starts a pool of worker threads
+/// @param num_threads Number of worker threads to start, at least 1
+/// @return a Thread_pool instance, or NULL if the threads could not be started
+Thread_pool tp_create( int num_threads ){
+    Thread_pool pool = calloc(1, sizeof(struct thread_pool_s));
+    if(pool == NULL)
+        return NULL;
+    pool->capacity = 64;
+    pool->tasks = malloc(pool->capacity * sizeof(Task));
+    pool->threads = malloc(num_threads * sizeof(pthread_t));
+    if(pool->tasks == NULL || pool->threads == NULL){
+        free(pool->tasks);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    for(int i = 0; i < num_threads; i++){
+        if(pthread_create(&pool->threads[i], NULL, worker, pool) != 0)
+            break;
+        pool->num_threads++;
+    }
+    if(pool->num_threads == 0){
+        tp_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/// tp_submit queues a task for a worker thread
+/// @param pool The subject Thread_pool
+/// @param task Function run on a worker thread
+/// @param arg Argument passed to task
+/// @return 1 on success, 0 on allocation failure
+int tp_submit( Thread_pool pool, void (*task)( void * arg ), void * arg ){
+    pthread_mutex_lock(&pool->lock);
+    if(pool->num_queued == pool->capacity){ // Double capacity, unwrapping the circular queue
+        Task * tasks = malloc(2 * pool->capacity * sizeof(Task));
+        if(tasks == NULL){
+            pthread_mutex_unlock(&pool->lock);
+            return 0;
+        }
+        for(size_t i = 0; i < pool->num_queued; i++)
+            tasks[i] = pool->tasks[(pool->head + i) % pool->capacity];
+        free(pool->tasks);
+        pool->tasks = tasks;
+        pool->head = 0;
+        pool->capacity *= 2;
+    }
+    Task new_task = { task, arg };
+    pool->tasks[(pool->head + pool->num_queued) % pool->capacity] = new_task;
+    pool->num_queued++;
+    pool->num_pending++;
+    pthread_cond_signal(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+    return 1;
+}
+
+/// tp_wait blocks until every task submitted to the pool has finished
+/// @param pool The subject Thread_pool
+void tp_wait( Thread_pool pool ){
+    pthread_mutex_lock(&pool->lock);
+    while(pool->num_pending > 0)
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/// tp_num_threads reports the number of worker threads in the pool
+/// @param pool The subject Thread_pool
+/// @return Number of worker threads
+int tp_num_threads( Thread_pool pool ){
+    return pool->num_threads;
+}
+
+/// tp_destroy finishes all queued tasks, stops the workers and frees the pool
+/// @param pool The subject Thread_pool
+/// @post the pool reference is no longer valid.
+void tp_destroy( Thread_pool pool ){
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+    for(int i = 0; i < pool->num_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+    free(pool->threads);
+    free(pool->tasks);
+    free(pool);
+}
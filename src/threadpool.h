@@ -0,0 +1,47 @@
+//
+// file: threadpool.h
+// description: Definition file for a fixed size pool of worker threads
+//
+// @author Daniel Tregea
+//
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <stddef.h>
+
+/// The Thread_pool type name is a pointer to a type that is opaque to clients.
+/// Tasks submitted to a pool run on its worker threads in submission order;
+/// tp_wait blocks until every submitted task has finished.
+typedef struct thread_pool_s * Thread_pool;
+
+/// Determine the number of worker threads to use when none is requested
+/// @return Number of online processors, at least 1
+int tp_default_threads( void );
+
+/// tp_create starts a pool of worker threads
+/// @param num_threads Number of worker threads to start, at least 1
+/// @return a Thread_pool instance, or NULL if the threads could not be started
+Thread_pool tp_create( int num_threads );
+
+/// tp_submit queues a task for a worker thread
+/// @param pool The subject Thread_pool
+/// @param task Function run on a worker thread
+/// @param arg Argument passed to task
+/// @return 1 on success, 0 on allocation failure
+int tp_submit( Thread_pool pool, void (*task)( void * arg ), void * arg );
+
+/// tp_wait blocks until every task submitted to the pool has finished
+/// @param pool The subject Thread_pool
+void tp_wait( Thread_pool pool );
+
+/// tp_num_threads reports the number of worker threads in the pool
+/// @param pool The subject Thread_pool
+/// @return Number of worker threads
+int tp_num_threads( Thread_pool pool );
+
+/// tp_destroy finishes all queued tasks, stops the workers and frees the pool
+/// @param pool The subject Thread_pool
+/// @post the pool reference is no longer valid.
+void tp_destroy( Thread_pool pool );
+
+#endif
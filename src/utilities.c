@@ -12,54 +12,16 @@
 #include <stdlib.h>
 #include <endian.h>
 
-/// Populate a look up table with symbol codes, given the head of a huffman tree
-/// @param lut Look up table to populate
-/// @param node Head of the huffman tree
-/// @param code Current code Generated from tree traversal.
-/// @param new_char New character to be added onto the code.
-/// @precondition code and new_char are empty strings on function call.
-void populate_lut( char ** lut, const Tree_node node, char * code, char * new_char ){
-    
-    // Base case
-    if(node == NULL)
-        return;
-        
-    
-    // Append the new char (0 or 1) onto the generated code
-    char * new_code = malloc(strlen(code) + 2);
-    strcpy(new_code, code);
-    strcat(new_code, new_char);
-    
-    // Leaf node of huffman tree reached, copy the generated code to its associated symbol
-    if(node->left == NULL && node->right == NULL){
-        lut[node->sym] = malloc(strlen(new_code) + 1);
-        strcpy(lut[node->sym], new_code);  
-      }
-    
-    // Traverse the left and right sub trees
-    populate_lut(lut, node->left, new_code, "0");
-    populate_lut(lut, node->right, new_code, "1");
-    
-    // Free code after subtree traversal finished
-    free(new_code);
-}
-
-/// Free all the dynamically allocated memory in the look up table
-/// @param lut
-void free_lut( char ** lut ){
-    for(int i = 0; i < 256; i++){
-        if(lut[i] != NULL)
-            free(lut[i]);
-    }
-}
-
-/// Determine the existance of the packman magic number in a file
-/// @param fp The file to find the magic number
-/// @return 1 for magic number found. 0 for magic number not found. -1 on error.
-int find_packman_magic( FILE * fp ){
-    uchar magic_number[2];
-    if(fread(magic_number, sizeof(uchar), 2, fp) == 0)
+/// Determine the existance of a packman magic number at the start of a file
+/// @param data The first bytes of the file
+/// @param len Number of bytes at data
+/// @param magic Set to the magic number read from the file
+/// @return 0 for a packman magic number found. 1 for magic number not found. -1 on error.
+int find_packman_magic( const uchar * data, size_t len, ushort * magic ){
+    uchar magic_number[2] = { 0, 0 };
+    if(len == 0)
         return -1;
+    memcpy(magic_number, data, len < 2 ? len : 2);
     
     // Combine the bytes of the two unsigned char's read to a unsigned short
     unsigned short magic_num_short = 0;
@@ -67,8 +29,9 @@ int find_packman_magic( FILE * fp ){
     magic_num_short <<= 8;
     magic_num_short |= magic_number[1];
     magic_num_short = htobe16(magic_num_short);
+    *magic = magic_num_short;
     
-    return magic_num_short == 0x80F0 ? 0 : 1;
+    return magic_num_short == PACKMAN_MAGIC || magic_num_short == PACKMAN_MAGIC_V2 ? 0 : 1;
 }
 
 /// Report errors and return EXIT_FAILURE
@@ -86,8 +49,8 @@ int handle_error( char * file_name, int line, char * input_file_name, char * mes
 /// Determine the number of unsigned integers needed to hold a number of bits
 /// @param num_bits Number of bits to be held in unsigned integers
 /// @return Number of unsigned integers to hold num_bits
-uint bits_to_num_uint( uint num_bits ){
-    uint num_uint = num_bits / 32; 
+uint64_t bits_to_num_uint( uint64_t num_bits ){
+    uint64_t num_uint = num_bits / 32; 
     if(num_bits % 32 > 0)
       num_uint++;
     return num_uint;
@@ -111,13 +74,13 @@ uint get_mask( uint bit_number ){
 }
 
 /// Determine the output stream from the command line
-/// @param argv Command line argument
+/// @param output_file Output file named on the command line, "-" for stdout
 /// @return Pointer to the stream specified in the command line arguments
-FILE * get_output_stream( char ** argv ){
+FILE * get_output_stream( char * output_file ){
     FILE * fp;
-    if(strcmp(argv[2], "-") == 0) // print
+    if(strcmp(output_file, "-") == 0) // print
         fp = stdout;
     else 
-        fp = fopen(argv[2], "wb");
+        fp = fopen(output_file, "wb");
     return fp;
 }
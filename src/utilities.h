@@ -10,22 +10,12 @@
 
 #include "packman_utils.h"
 
-/// Populate a look up table with symbol codes, given the head of a huffman tree
-/// @param lut Look up table to populate
-/// @param node Head of the huffman tree
-/// @param code Current code Generated from tree traversal.
-/// @param new_char New character to be added onto the code.
-/// @precondition code and new_char are empty strings on function call.
-void populate_lut( char ** lut, const Tree_node node, char * code, char * new_char );
-
-/// Free all the dynamically allocated memory in the look up table
-/// @param lut
-void free_lut( char ** lut );
-
-/// Determine the existance of the packman magic number in a file
-/// @param fp The file to find the magic number
-/// @return 1 for magic number found. 0 for magic number not found. -1 on error.
-int find_packman_magic( FILE * fp );
+/// Determine the existance of a packman magic number at the start of a file
+/// @param data The first bytes of the file
+/// @param len Number of bytes at data
+/// @param magic Set to the magic number read from the file
+/// @return 0 for a packman magic number found. 1 for magic number not found. -1 on error.
+int find_packman_magic( const uchar * data, size_t len, ushort * magic );
 
 /// Report errors and return EXIT_FAILURE
 /// @param file_name Name of the file the error occured in
@@ -38,7 +28,7 @@ int handle_error( char * file_name, int line, char * input_file_name, char * mes
 /// Determine the number of unsigned integers needed to hold a number of bits
 /// @param num_bits Number of bits to be held in unsigned integers
 /// @return Number of unsigned integers to hold num_bits
-uint bits_to_num_uint( uint num_bits );
+uint64_t bits_to_num_uint( uint64_t num_bits );
 
 /// Determine the unsigned integer holding the bit at position bit_number
 /// @param bit_number The position of the bit
@@ -51,8 +41,8 @@ uint get_byte_index( uint bit_number );
 uint get_mask( uint bit_number );
 
 /// Determine the output stream from the command line
-/// @param argv Command line argument
+/// @param output_file Output file named on the command line, "-" for stdout
 /// @return Pointer to the stream specified in the command line arguments
-FILE * get_output_stream( char ** argv );
+FILE * get_output_stream( char * output_file );
 
 #endif
\ No newline at end of file